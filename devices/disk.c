@@ -7,9 +7,17 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use bus master DMA when the controller is a PCI IDE
+   function with a bus master interface, such as the PIIX that
+   QEMU and Bochs emulate, and programmed I/O otherwise.  With DMA
+   the controller copies the data to or from memory on its own and
+   interrupts once at the end, so the CPU is free for the whole
+   transfer. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -32,6 +40,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +56,42 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  ERR and INTR are cleared by
+   writing 1 to them. */
+#define BM_ST_ACTIVE 0x01       /* Transfer in progress. */
+#define BM_ST_ERR 0x02          /* Transfer failed. */
+#define BM_ST_INTR 0x04         /* Disk interrupted. */
+
+/* PCI configuration space access, mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* A physical region descriptor: one physically contiguous piece
+   of a DMA transfer.  A region may not cross a 64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the last region. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Regions per transfer.  A DISK_XFER_MAX-sector transfer is
+   physically contiguous, since it is in the kernel's mapping of
+   physical memory, so it crosses at most two 64 kB boundaries. */
+#define PRD_MAX 4
 
 /* An ATA device. */
 struct disk {
@@ -56,6 +101,7 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	bool dma;                   /* Use DMA for transfers? */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
@@ -73,6 +119,10 @@ struct channel {
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+	uint16_t bm_base;           /* Bus master base port, 0 if none. */
+	struct prd prdt[PRD_MAX]    /* DMA table, no 64 kB crossing. */
+		__attribute__ ((aligned (sizeof (struct prd) * PRD_MAX)));
+
 	struct disk devices[2];     /* The devices on this channel. */
 };
 
@@ -84,10 +134,17 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static uint16_t find_bus_master (void);
+
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void pio_read (struct disk *, disk_sector_t, size_t cnt, void *);
+static void pio_write (struct disk *, disk_sector_t, size_t cnt,
+		const void *);
+static bool dma_transfer (struct disk *, disk_sector_t, size_t cnt,
+		void *, bool write);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -99,6 +156,7 @@ static void interrupt_handler (struct intr_frame *);
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = find_bus_master ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -122,6 +180,7 @@ disk_init (void) {
 		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,6 +191,7 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->dma = false;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -209,47 +269,132 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_read_many (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_many (d, sec_no, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Each command moves up to DISK_XFER_MAX sectors, so a
+   long range costs one command setup per DISK_XFER_MAX sectors
+   instead of one per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_many (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
 	struct channel *c;
+	uint8_t *p = buffer;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
 	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	while (cnt > 0) {
+		size_t n = cnt < DISK_XFER_MAX ? cnt : DISK_XFER_MAX;
+
+		lock_acquire (&c->lock);
+		if (!dma_transfer (d, sec_no, n, p, false))
+			pio_read (d, sec_no, n, p);
+		d->read_cnt += n;
+		lock_release (&c->lock);
+
+		p += n * DISK_SECTOR_SIZE;
+		sec_no += n;
+		cnt -= n;
+	}
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data.  Each command moves up to DISK_XFER_MAX sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+disk_write_many (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
 	struct channel *c;
+	const uint8_t *p = buffer;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
 	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
+	while (cnt > 0) {
+		size_t n = cnt < DISK_XFER_MAX ? cnt : DISK_XFER_MAX;
+
+		lock_acquire (&c->lock);
+		if (!dma_transfer (d, sec_no, n, (void *) p, true))
+			pio_write (d, sec_no, n, p);
+		d->write_cnt += n;
+		lock_release (&c->lock);
+
+		p += n * DISK_SECTOR_SIZE;
+		sec_no += n;
+		cnt -= n;
+	}
+}
+
+/* Reads CNT sectors, at most DISK_XFER_MAX, starting at SEC_NO
+   from disk D into BUFFER with programmed I/O.  The channel's
+   lock must be held. */
+static void
+pio_read (struct disk *d, disk_sector_t sec_no, size_t cnt, void *buffer) {
+	struct channel *c = d->channel;
+	uint8_t *p = buffer;
+	size_t i;
+
+	select_sectors (d, sec_no, cnt);
+	issue_command (c, CMD_READ_SECTOR_RETRY);
+	/* The disk interrupts once per sector, as each becomes ready
+	   to be read. */
+	for (i = 0; i < cnt; i++) {
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu,
+					d->name, sec_no + (disk_sector_t) i);
+		input_sector (c, p);
+		p += DISK_SECTOR_SIZE;
+	}
+}
+
+/* Writes CNT sectors, at most DISK_XFER_MAX, starting at SEC_NO
+   to disk D from BUFFER with programmed I/O.  The channel's lock
+   must be held. */
+static void
+pio_write (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	struct channel *c = d->channel;
+	const uint8_t *p = buffer;
+	size_t i;
+
+	select_sectors (d, sec_no, cnt);
+	issue_command (c, CMD_WRITE_SECTOR_RETRY);
+	/* The first sector goes as soon as the disk asks for it;
+	   after that the disk interrupts once per sector written,
+	   asking for the next one until the last. */
+	for (i = 0; i < cnt; i++) {
+		if (i > 0)
+			sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu,
+					d->name, sec_no + (disk_sector_t) i);
+		output_sector (c, p);
+		p += DISK_SECTOR_SIZE;
+	}
 	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -353,7 +498,7 @@ identify_ata_device (struct disk *d) {
 	   indicating the device's response is ready, and read the data
 	   into our buffer. */
 	select_device_wait (d);
-	issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+	issue_command (c, CMD_IDENTIFY_DEVICE);
 	sema_down (&c->completion_wait);
 	if (!wait_while_busy (d)) {
 		d->is_ata = false;
@@ -364,6 +509,9 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 49 bit 8 says whether the device supports DMA. */
+	d->dma = c->bm_base != 0 && (id[49] & (1 << 8)) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -402,17 +550,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and sector
+   count registers.  (We use LBA mode.)  A count of 0 in the
+   register means DISK_XFER_MAX sectors. */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_XFER_MAX);
+	ASSERT (sec_no < d->capacity && cnt <= d->capacity - sec_no);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_XFER_MAX ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -423,7 +573,7 @@ select_sector (struct disk *d, disk_sector_t sec_no) {
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) {
+issue_command (struct channel *c, uint8_t command) {
 	/* Interrupts must be enabled or our semaphore will never be
 	   up'd by the completion handler. */
 	ASSERT (intr_get_level () == INTR_ON);
@@ -446,6 +596,145 @@ output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA. */
+
+static uint32_t pci_read_config (int bus, int dev, int func, int reg);
+static void pci_write_config (int bus, int dev, int func, int reg,
+		uint32_t value);
+
+/* Looks on PCI bus 0 for an IDE controller with a bus master
+   interface whose channels are at the legacy ports, turns on its
+   bus mastering, and returns the base port of its bus master
+   registers.  Returns 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t id = pci_read_config (0, dev, func, 0x00);
+			uint32_t class = pci_read_config (0, dev, func, 0x08);
+			uint32_t bar4, command;
+
+			if ((id & 0xffff) == 0xffff)
+				continue;
+
+			/* Class 1, subclass 1 is IDE.  In the programming
+			   interface, bit 7 is the bus master interface and
+			   bits 0 and 2 put a channel at non-legacy ports. */
+			if ((class >> 16) != 0x0101 || (class & 0x8000) == 0
+					|| (class & 0x0500) != 0)
+				continue;
+
+			/* BAR4 holds the bus master registers, in I/O space. */
+			bar4 = pci_read_config (0, dev, func, 0x20);
+			if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+				continue;
+
+			/* Enable I/O space and bus mastering.  Writing zeros
+			   to the status half leaves it alone. */
+			command = pci_read_config (0, dev, func, 0x04) & 0xffff;
+			pci_write_config (0, dev, func, 0x04, command | 0x05);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
+/* Returns the 32-bit PCI configuration register at byte offset
+   REG of function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000u | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets the 32-bit PCI configuration register at byte offset REG
+   of function FUNC of device DEV on bus BUS to VALUE. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR, 0x80000000u | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Fills in channel C's PRD table for a transfer of SIZE bytes to
+   or from BUFFER.  Returns false if the controller cannot reach
+   BUFFER: it must be a word-aligned kernel address in the first
+   4 GB of physical memory. */
+static bool
+build_prdt (struct channel *c, const void *buffer, size_t size) {
+	uint64_t pa, end;
+	size_t i = 0;
+
+	if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+		return false;
+	pa = vtop (buffer);
+	end = pa + size;
+	if (end > (1ULL << 32))
+		return false;
+
+	while (pa < end) {
+		uint64_t boundary = (pa | 0xffff) + 1;
+		uint64_t n = (boundary < end ? boundary : end) - pa;
+
+		if (i >= PRD_MAX)
+			return false;
+		c->prdt[i].addr = pa;
+		c->prdt[i].size = n & 0xffff;
+		c->prdt[i].flags = 0;
+		pa += n;
+		i++;
+	}
+	c->prdt[i - 1].flags = PRD_EOT;
+	return true;
+}
+
+/* Transfers CNT sectors, at most DISK_XFER_MAX, starting at
+   SEC_NO between disk D and BUFFER with bus master DMA, writing
+   to the disk if WRITE is true and reading from it otherwise.
+   Sleeps until the whole transfer is done.  The channel's lock
+   must be held.
+
+   Returns false if DMA cannot be used, in which case nothing has
+   been transferred and the caller should fall back to programmed
+   I/O.  After a failed DMA transfer the disk gets programmed I/O
+   only. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer, bool write) {
+	struct channel *c = d->channel;
+	uint8_t direction = write ? 0 : BM_CMD_READ;
+	uint8_t bm_status;
+
+	if (!d->dma || !build_prdt (c, buffer, cnt * DISK_SECTOR_SIZE))
+		return false;
+
+	/* Point the controller at the table and clear old status. */
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_ST_ERR | BM_ST_INTR);
+	outb (reg_bm_command (c), direction);
+
+	select_sectors (d, sec_no, cnt);
+	issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), direction | BM_CMD_START);
+
+	/* One interrupt, when the disk is done. */
+	sema_down (&c->completion_wait);
+	outb (reg_bm_command (c), direction);
+	bm_status = inb (reg_bm_status (c));
+	outb (reg_bm_status (c), bm_status | BM_ST_ERR | BM_ST_INTR);
+
+	if ((bm_status & (BM_ST_ERR | BM_ST_ACTIVE)) != 0
+			|| (inb (reg_alt_status (c)) & (STA_BSY | STA_DRQ | STA_ERR)) != 0) {
+		printf ("%s: DMA %s failed, sector=%"PRDSNu"; using PIO\n",
+				d->name, write ? "write" : "read", sec_no);
+		d->dma = false;
+		return false;
+	}
+	return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
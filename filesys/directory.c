@@ -1,10 +1,14 @@
 #include "filesys/directory.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,11 +23,426 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+/* Directories come in two formats.
+ *
+ * A plain directory is just an array of dir_entry, searched from
+ * the start on every lookup.  Older file systems have only these,
+ * and they still work.
+ *
+ * dir_create() makes hashed directories, laid out as a linear
+ * hash table (Litwin) of one-sector blocks.  Block 0 holds a
+ * dir_header.  Every other block holds BLOCK_ENTRIES entries and
+ * the number of the next block in its chain, or 0.  Each bucket
+ * is a primary block plus a chain of overflow blocks.  When the
+ * table passes its load factor, bucket SPLIT is split: the
+ * entries that hash to its new twin move there, so the table
+ * grows one bucket at a time and never rehashes as a whole.
+ * Lookup, insertion and removal read O(1) blocks on average.
+ *
+ * Buckets are allocated in groups that double in size.  Group 0
+ * is bucket 0, group G > 0 is buckets 2^(G-1) through 2^G - 1,
+ * and each group is contiguous in the file, so finding a bucket's
+ * block takes no extra reads. */
+#define DIR_HASH_MAGIC 0x48444952       /* Marks a hashed directory. */
+#define BLOCK_ENTRIES \
+	((DISK_SECTOR_SIZE - sizeof (uint32_t)) / sizeof (struct dir_entry))
+#define GROUP_CNT 32
+
+/* Block 0 of a hashed directory.  A plain directory can never
+ * start with DIR_HASH_MAGIC, since no disk is that large. */
+struct dir_header {
+	uint32_t magic;                     /* DIR_HASH_MAGIC. */
+	uint32_t level;                     /* 2^LEVEL buckets before splits. */
+	uint32_t split;                     /* Next bucket to split. */
+	uint32_t entry_cnt;                 /* Entries in use. */
+	uint32_t block_cnt;                 /* Blocks used or reserved. */
+	uint32_t group[GROUP_CNT];          /* First block of each group. */
+};
+
+/* Reads DIR's header into *H.  Returns true if DIR is hashed,
+ * false if it is plain. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) {
+	return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+		&& h->magic == DIR_HASH_MAGIC;
+}
+
+static bool
+write_header (struct dir *dir, const struct dir_header *h) {
+	return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the byte offset of entry I in block BLK. */
+static off_t
+entry_ofs (uint32_t blk, size_t i) {
+	return (off_t) blk * DISK_SECTOR_SIZE + i * sizeof (struct dir_entry);
+}
+
+/* Returns the block after BLK in its chain, or 0 at the end. */
+static uint32_t
+next_block (const struct dir *dir, uint32_t blk) {
+	uint32_t next;
+
+	if (inode_read_at (dir->inode, &next, sizeof next,
+				entry_ofs (blk, BLOCK_ENTRIES)) != sizeof next)
+		return 0;
+	return next;
+}
+
+/* Links block NEXT after BLK. */
+static bool
+set_next_block (struct dir *dir, uint32_t blk, uint32_t next) {
+	return inode_write_at (dir->inode, &next, sizeof next,
+			entry_ofs (blk, BLOCK_ENTRIES)) == sizeof next;
+}
+
+/* Fills block BLK with free entries and no successor. */
+static bool
+clear_block (struct dir *dir, uint32_t blk) {
+	static const char zeros[DISK_SECTOR_SIZE];
+
+	return inode_write_at (dir->inode, zeros, DISK_SECTOR_SIZE,
+			entry_ofs (blk, 0)) == DISK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that NAME belongs in. */
+static uint32_t
+name_to_bucket (const struct dir_header *h, const char *name) {
+	uint32_t hash = hash_string (name);
+	uint32_t bucket = hash & ((1u << h->level) - 1);
+
+	if (bucket < h->split)
+		bucket = hash & ((2u << h->level) - 1);
+	return bucket;
+}
+
+/* Returns the primary block of BUCKET. */
+static uint32_t
+bucket_to_block (const struct dir_header *h, uint32_t bucket) {
+	int group;
+
+	if (bucket == 0)
+		return h->group[0];
+	group = 32 - __builtin_clz (bucket);
+	return h->group[group] + (bucket - (1u << (group - 1)));
+}
+
+/* Searches the bucket of hashed directory DIR, whose header is H,
+ * for NAME.  Returns true and sets *EP and *OFSP as lookup() does
+ * if it is found.  Otherwise, if FREE_OFSP is non-null, sets it to
+ * the offset of a free slot in the bucket, or to -1 if there is
+ * none, in which case *TAILP is set to the last block. */
+static bool
+hashed_lookup (const struct dir *dir, const struct dir_header *h,
+		const char *name, struct dir_entry *ep, off_t *ofsp,
+		off_t *free_ofsp, uint32_t *tailp) {
+	uint32_t blk = bucket_to_block (h, name_to_bucket (h, name));
+	uint32_t next;
+	struct dir_entry e;
+	size_t i;
+
+	if (free_ofsp != NULL)
+		*free_ofsp = -1;
+	for (;;) {
+		for (i = 0; i < BLOCK_ENTRIES; i++) {
+			off_t ofs = entry_ofs (blk, i);
+
+			if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+				return false;
+			if (e.in_use && !strcmp (name, e.name)) {
+				if (ep != NULL)
+					*ep = e;
+				if (ofsp != NULL)
+					*ofsp = ofs;
+				return true;
+			}
+			if (!e.in_use && free_ofsp != NULL && *free_ofsp == -1)
+				*free_ofsp = ofs;
+		}
+
+		next = next_block (dir, blk);
+		if (next == 0)
+			break;
+		blk = next;
+	}
+	if (tailp != NULL)
+		*tailp = blk;
+	return false;
+}
+
+/* Splits bucket H->split of hashed directory DIR, moving the
+ * entries that rehash to the new bucket.  Entries are copied
+ * before they are erased, so running out of disk part way leaves
+ * the table as it was. */
+static bool
+split_bucket (struct dir *dir, struct dir_header *h) {
+	uint32_t old = h->split;
+	uint32_t new = (1u << h->level) + h->split;
+	uint32_t mask = (2u << h->level) - 1;
+	uint32_t blk, dst, block_cnt = h->block_cnt;
+	struct dir_entry e;
+	size_t i, dst_i;
+
+	/* The first split at a level starts the next group. */
+	if (h->split == 0) {
+		if (h->level + 1 >= GROUP_CNT)
+			return false;
+		h->group[h->level + 1] = h->block_cnt;
+		block_cnt += 1u << h->level;
+	}
+	dst = bucket_to_block (h, new);
+	if (!clear_block (dir, dst))
+		return false;
+
+	/* Copy. */
+	dst_i = 0;
+	for (blk = bucket_to_block (h, old); blk != 0; blk = next_block (dir, blk))
+		for (i = 0; i < BLOCK_ENTRIES; i++) {
+			if (inode_read_at (dir->inode, &e, sizeof e, entry_ofs (blk, i))
+					!= sizeof e)
+				return false;
+			if (!e.in_use || (hash_string (e.name) & mask) == old)
+				continue;
+
+			if (dst_i == BLOCK_ENTRIES) {
+				uint32_t overflow = block_cnt;
+				if (!clear_block (dir, overflow)
+						|| !set_next_block (dir, dst, overflow))
+					return false;
+				block_cnt++;
+				dst = overflow;
+				dst_i = 0;
+			}
+			if (inode_write_at (dir->inode, &e, sizeof e,
+						entry_ofs (dst, dst_i++)) != sizeof e)
+				return false;
+		}
+
+	/* Erase. */
+	for (blk = bucket_to_block (h, old); blk != 0; blk = next_block (dir, blk))
+		for (i = 0; i < BLOCK_ENTRIES; i++) {
+			off_t ofs = entry_ofs (blk, i);
+
+			inode_read_at (dir->inode, &e, sizeof e, ofs);
+			if (e.in_use && (hash_string (e.name) & mask) != old) {
+				e.in_use = false;
+				inode_write_at (dir->inode, &e, sizeof e, ofs);
+			}
+		}
+
+	h->block_cnt = block_cnt;
+	if (++h->split == 1u << h->level) {
+		h->level++;
+		h->split = 0;
+	}
+	return true;
+}
+
+/* Adds an entry for NAME and INODE_SECTOR to hashed directory DIR,
+ * whose header is H. */
+static bool
+hashed_add (struct dir *dir, struct dir_header *h, const char *name,
+		disk_sector_t inode_sector) {
+	struct dir_entry e;
+	uint32_t tail;
+	off_t ofs;
+
+	if (hashed_lookup (dir, h, name, NULL, NULL, &ofs, &tail))
+		return false;
+
+	/* Chain an overflow block if the bucket is full. */
+	if (ofs == -1) {
+		uint32_t overflow = h->block_cnt;
+		if (!clear_block (dir, overflow) || !set_next_block (dir, tail, overflow))
+			return false;
+		h->block_cnt++;
+		ofs = entry_ofs (overflow, 0);
+	}
+
+	e.in_use = true;
+	strlcpy (e.name, name, sizeof e.name);
+	e.inode_sector = inode_sector;
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
+		write_header (dir, h);
+		return false;
+	}
+
+	/* Keep the load factor at or below 3/4.  Failing to split only
+	 * costs speed. */
+	h->entry_cnt++;
+	if (h->entry_cnt * 4
+			> ((1u << h->level) + h->split) * BLOCK_ENTRIES * 3)
+		split_bucket (dir, h);
+	return write_header (dir, h);
+}
+
+/* Directory-entry cache.  Maps a directory's inode sector and a
+ * name in it to the named file's inode sector, or to 0 if the
+ * directory has no such name, so that repeated lookups, including
+ * failed ones, need no directory reads.  dir_add() and
+ * dir_remove() update the entry for the name they change, and
+ * dir_create() drops entries left over from an earlier directory
+ * in the same sector, which keeps every entry exact. */
+#define DCACHE_MAX 512
+
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in dcache. */
+	struct list_elem lru_elem;          /* Element in dcache_lru. */
+	disk_sector_t parent;               /* Directory's inode sector. */
+	disk_sector_t inode_sector;         /* File's inode sector, or 0. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+};
+
+static struct hash dcache;
+static struct list dcache_lru;          /* Most recently used first. */
+static struct lock dcache_lock;         /* Protects the above. */
+static long long dcache_hit_cnt, dcache_miss_cnt;
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached entry for NAME in directory PARENT, or a null
+ * pointer.  dcache_lock must be held. */
+static struct dentry *
+dcache_find (disk_sector_t parent, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks NAME up in directory PARENT in the cache.  On a hit, sets
+ * *SECTORP to the file's inode sector, or 0 if it does not exist,
+ * and returns true. */
+static bool
+dcache_lookup (disk_sector_t parent, const char *name,
+		disk_sector_t *sectorp) {
+	struct dentry *d;
+
+	fs_lock_acquire (&dcache_lock, FS_LOCK_DCACHE);
+	d = dcache_find (parent, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+		*sectorp = d->inode_sector;
+		dcache_hit_cnt++;
+	} else
+		dcache_miss_cnt++;
+	fs_lock_release (&dcache_lock, FS_LOCK_DCACHE);
+	return d != NULL;
+}
+
+/* Records that NAME in directory PARENT is INODE_SECTOR, or does
+ * not exist if INODE_SECTOR is 0.  If REPLACE is false, an entry
+ * already present wins: it was stored by dir_add() or dir_remove()
+ * and is newer than what a concurrent lookup read from disk. */
+static void
+dcache_store (disk_sector_t parent, const char *name,
+		disk_sector_t inode_sector, bool replace) {
+	struct dentry *d;
+
+	fs_lock_acquire (&dcache_lock, FS_LOCK_DCACHE);
+	d = dcache_find (parent, name);
+	if (d == NULL) {
+		if (hash_size (&dcache) >= DCACHE_MAX) {
+			d = list_entry (list_pop_back (&dcache_lru), struct dentry, lru_elem);
+			hash_delete (&dcache, &d->hash_elem);
+		} else
+			d = malloc (sizeof *d);
+		if (d != NULL) {
+			d->parent = parent;
+			strlcpy (d->name, name, sizeof d->name);
+			d->inode_sector = inode_sector;
+			hash_insert (&dcache, &d->hash_elem);
+			list_push_front (&dcache_lru, &d->lru_elem);
+		}
+	} else if (replace) {
+		d->inode_sector = inode_sector;
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+	}
+	fs_lock_release (&dcache_lock, FS_LOCK_DCACHE);
+}
+
+/* Drops every cached entry for the directory in sector PARENT. */
+static void
+dcache_forget_dir (disk_sector_t parent) {
+	struct list_elem *e, *next;
+
+	fs_lock_acquire (&dcache_lock, FS_LOCK_DCACHE);
+	for (e = list_begin (&dcache_lru); e != list_end (&dcache_lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (d->parent == parent) {
+			list_remove (&d->lru_elem);
+			hash_delete (&dcache, &d->hash_elem);
+			free (d);
+		}
+	}
+	fs_lock_release (&dcache_lock, FS_LOCK_DCACHE);
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	hash_init (&dcache, dentry_hash, dentry_less, NULL);
+	list_init (&dcache_lru);
+	lock_init (&dcache_lock);
+}
+
+/* Prints directory-entry cache statistics. */
+void
+dir_print_stats (void) {
+	printf ("Dentry cache: %lld hits, %lld misses\n",
+			dcache_hit_cnt, dcache_miss_cnt);
+}
+
+/* Creates a hashed directory in the given SECTOR, sized for
+ * ENTRY_CNT entries.  Returns true if successful, false on
+ * failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	struct dir_header h;
+	struct dir *dir;
+	uint32_t group;
+	bool success;
+
+	/* Start with enough buckets for ENTRY_CNT, all in the initial
+	 * zero-filled length, and groups laid out back to back. */
+	memset (&h, 0, sizeof h);
+	h.magic = DIR_HASH_MAGIC;
+	while (h.level + 1 < GROUP_CNT
+			&& (1u << h.level) * BLOCK_ENTRIES * 3 < entry_cnt * 4)
+		h.level++;
+	h.block_cnt = 1 + (1u << h.level);
+	h.group[0] = 1;
+	for (group = 1; group <= h.level; group++)
+		h.group[group] = 1 + (1u << (group - 1));
+
+	if (!inode_create (sector, (off_t) h.block_cnt * DISK_SECTOR_SIZE,
+				true))
+		return false;
+	dcache_forget_dir (sector);
+	dir = dir_open (inode_open (sector));
+	success = dir != NULL && write_header (dir, &h);
+	dir_close (dir);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -79,12 +498,16 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	struct dir_header h;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (read_header (dir, &h))
+		return hashed_lookup (dir, &h, name, ep, ofsp, NULL, NULL);
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -104,38 +527,39 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t parent;
+	disk_sector_t sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
+	parent = inode_get_inumber (dir->inode);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
+	if (strlen (name) > NAME_MAX) {
 		*inode = NULL;
+		return false;
+	}
+
+	/* Open the inode before letting go of the directory, so that a
+	 * concurrent dir_remove() cannot free its sector in between. */
+	inode_lock_dir (dir->inode);
+	if (!dcache_lookup (parent, name, &sector)) {
+		sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+		dcache_store (parent, name, sector, false);
+	}
+	*inode = sector != 0 ? inode_open (sector) : NULL;
+	inode_unlock_dir (dir->inode);
 
 	return *inode != NULL;
 }
 
-/* Adds a file named NAME to DIR, which must not already contain a
- * file by that name.  The file's inode is in sector
- * INODE_SECTOR.
- * Returns true if successful, false on failure.
- * Fails if NAME is invalid (i.e. too long) or a disk or memory
- * error occurs. */
-bool
-dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+/* Adds an entry for NAME and INODE_SECTOR to plain directory DIR. */
+static bool
+plain_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
 
-	ASSERT (dir != NULL);
-	ASSERT (name != NULL);
-
-	/* Check NAME for validity. */
-	if (*name == '\0' || strlen (name) > NAME_MAX)
-		return false;
-
 	/* Check that NAME is not in use. */
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
@@ -162,11 +586,48 @@ done:
 	return success;
 }
 
+/* Adds a file named NAME to DIR, which must not already contain a
+ * file by that name.  The file's inode is in sector
+ * INODE_SECTOR.
+ * Returns true if successful, false on failure.
+ * Fails if NAME is invalid (i.e. too long) or a disk or memory
+ * error occurs. */
+bool
+dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	disk_sector_t parent;
+	disk_sector_t sector;
+	struct dir_header h;
+	bool success;
+
+	ASSERT (dir != NULL);
+	ASSERT (name != NULL);
+	parent = inode_get_inumber (dir->inode);
+
+	/* Check NAME for validity. */
+	if (*name == '\0' || strlen (name) > NAME_MAX)
+		return false;
+
+	/* A cached entry can show that NAME is taken without a search. */
+	if (dcache_lookup (parent, name, &sector) && sector != 0)
+		return false;
+
+	inode_lock_dir (dir->inode);
+	if (read_header (dir, &h))
+		success = hashed_add (dir, &h, name, inode_sector);
+	else
+		success = plain_add (dir, name, inode_sector);
+	if (success)
+		dcache_store (parent, name, inode_sector, true);
+	inode_unlock_dir (dir->inode);
+	return success;
+}
+
 /* Removes any entry for NAME in DIR.
  * Returns true if successful, false on failure,
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_header h;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -175,6 +636,8 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	inode_lock_dir (dir->inode);
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -188,29 +651,60 @@ dir_remove (struct dir *dir, const char *name) {
 	e.in_use = false;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
+	if (read_header (dir, &h)) {
+		h.entry_cnt--;
+		write_header (dir, &h);
+	}
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_store (inode_get_inumber (dir->inode), name, 0, true);
 	success = true;
 
 done:
+	inode_unlock_dir (dir->inode);
 	inode_close (inode);
 	return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
- * NAME.  Returns true if successful, false if the directory
- * contains no more entries. */
-bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
+/* dir_readdir() with DIR's entries locked. */
+static bool
+readdir_locked (struct dir *dir, char name[NAME_MAX + 1]) {
+	struct dir_header h;
 	struct dir_entry e;
-
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	bool hashed = read_header (dir, &h);
+
+	/* A hashed directory is scanned block by block, skipping the
+	 * header and each block's chain link.  Blocks reserved for
+	 * buckets not yet split read as free entries. */
+	for (;;) {
+		if (hashed) {
+			if (dir->pos < DISK_SECTOR_SIZE)
+				dir->pos = DISK_SECTOR_SIZE;
+			if (dir->pos % DISK_SECTOR_SIZE / sizeof e >= BLOCK_ENTRIES)
+				dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE);
+			if ((uint32_t) (dir->pos / DISK_SECTOR_SIZE) >= h.block_cnt)
+				return false;
+		}
+		if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+			return false;
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
 			return true;
 		}
 	}
-	return false;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+ * NAME.  Returns true if successful, false if the directory
+ * contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
+	bool success;
+
+	inode_lock_dir (dir->inode);
+	success = readdir_locked (dir, name);
+	inode_unlock_dir (dir->inode);
+	return success;
 }
@@ -1,6 +1,8 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -22,20 +24,26 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;            /* Where the next free search starts. */
+	struct bitmap *free_clusters;   /* One bit per cluster, true if free. */
+	struct bitmap *dirty_sectors;   /* FAT sectors changed since fat_close(). */
+	struct lock write_lock;         /* Protects all of the above. */
 };
 
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_table_alloc (void);
+static size_t fat_whole_sectors (void);
+static void fat_set (cluster_t clst, cluster_t val);
 
 void
 fat_init (void) {
 	fat_fs = calloc (1, sizeof (struct fat_fs));
 	if (fat_fs == NULL)
 		PANIC ("FAT init failed");
+	lock_init (&fat_fs->write_lock);
 
 	// Read boot sector from the disk
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
@@ -53,33 +61,32 @@ fat_init (void) {
 
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
+	cluster_t clst;
+
+	fat_table_alloc ();
 
-	// Load FAT directly from the disk
+	// Load FAT directly from the disk, whole sectors in one range
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+	size_t whole = fat_whole_sectors ();
+	off_t bytes_left = fat_size_in_bytes - whole * DISK_SECTOR_SIZE;
+	disk_read_many (filesys_disk, fat_fs->bs.fat_start, whole, buffer);
+	if (bytes_left > 0 && whole < fat_fs->bs.fat_sectors) {
+		uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT load failed");
+		disk_read (filesys_disk, fat_fs->bs.fat_start + whole, bounce);
+		memcpy (buffer + whole * DISK_SECTOR_SIZE, bounce, bytes_left);
+		free (bounce);
 	}
+
+	/* Cluster 0 is reserved, so it never looks free. */
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		bitmap_set (fat_fs->free_clusters, clst, fat_fs->fat[clst] == 0);
 }
 
+/* Writes the boot sector and every FAT sector changed since the
+ * last call to disk. */
 void
 fat_close (void) {
 	// Write FAT boot sector
@@ -90,27 +97,36 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	// Write dirty FAT sectors directly to the disk, each run of
+	// consecutive dirty sectors as one range
+	fs_lock_acquire (&fat_fs->write_lock, FS_LOCK_ALLOC);
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
+	size_t whole = fat_whole_sectors ();
+	size_t i = 0;
+	while ((i = bitmap_scan (fat_fs->dirty_sectors, i, 1, true)) < whole) {
+		size_t end = bitmap_scan (fat_fs->dirty_sectors, i, 1, false);
+		if (end > whole)
+			end = whole;
+		disk_write_many (filesys_disk, fat_fs->bs.fat_start + i, end - i,
+		                 buffer + i * DISK_SECTOR_SIZE);
+		i = end;
+	}
+	for (i = whole; i < fat_fs->bs.fat_sectors; i++) {
+		off_t bytes_wrote = i * DISK_SECTOR_SIZE;
+		off_t bytes_left = fat_size_in_bytes - bytes_wrote;
+		if (!bitmap_test (fat_fs->dirty_sectors, i))
+			continue;
+		bounce = calloc (1, DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT close failed");
+		if (bytes_left > 0)
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+		disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+		free (bounce);
 	}
+	bitmap_set_all (fat_fs->dirty_sectors, false);
+	fs_lock_release (&fat_fs->write_lock, FS_LOCK_ALLOC);
 }
 
 void
@@ -119,10 +135,11 @@ fat_create (void) {
 	fat_boot_create ();
 	fat_fs_init ();
 
-	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT creation failed");
+	// Create FAT table, all free and all to be written
+	fat_table_alloc ();
+	bitmap_set_all (fat_fs->free_clusters, true);
+	bitmap_reset (fat_fs->free_clusters, 0);
+	bitmap_set_all (fat_fs->dirty_sectors, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -137,14 +154,16 @@ fat_create (void) {
 
 void
 fat_boot_create (void) {
+	/* The FAT follows the journal. */
+	unsigned int fat_start = JOURNAL_SECTOR + JOURNAL_SECTORS;
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (disk_size (filesys_disk) - fat_start)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
 	    .total_sectors = disk_size (filesys_disk),
-	    .fat_start = 1,
+	    .fat_start = fat_start,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
 	};
@@ -152,42 +171,130 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+	                     / SECTORS_PER_CLUSTER;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+}
+
+/* Allocates the in-memory FAT and its bitmaps, replacing any
+ * left from formatting. */
+static void
+fat_table_alloc (void) {
+	free (fat_fs->fat);
+	bitmap_destroy (fat_fs->free_clusters);
+	bitmap_destroy (fat_fs->dirty_sectors);
+
+	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
+	fat_fs->free_clusters = bitmap_create (fat_fs->fat_length);
+	fat_fs->dirty_sectors = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->fat == NULL || fat_fs->free_clusters == NULL
+	    || fat_fs->dirty_sectors == NULL)
+		PANIC ("FAT allocation failed");
+}
+
+/* Returns the number of FAT sectors that the in-memory table
+ * fills completely.  These move straight between the table and
+ * the disk; a partial last sector goes through a bounce buffer. */
+static size_t
+fat_whole_sectors (void) {
+	size_t whole = fat_fs->fat_length * sizeof (cluster_t) / DISK_SECTOR_SIZE;
+	return whole < fat_fs->bs.fat_sectors ? whole : fat_fs->bs.fat_sectors;
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Sets FAT entry CLST to VAL and keeps the free-cluster and
+ * dirty-sector bitmaps in step.  The FAT sector that holds the
+ * entry is logged in the journal, from the in-memory table, so a
+ * crash leaves the on-disk FAT consistent with the inodes that use
+ * it.  The caller must hold write_lock. */
+static void
+fat_set (cluster_t clst, cluster_t val) {
+	size_t idx = clst * sizeof (cluster_t) / DISK_SECTOR_SIZE;
+	size_t ofs = idx * DISK_SECTOR_SIZE;
+	size_t bytes = fat_fs->fat_length * sizeof (cluster_t) - ofs;
+
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+
+	fat_fs->fat[clst] = val;
+	bitmap_set (fat_fs->free_clusters, clst, val == 0);
+	bitmap_mark (fat_fs->dirty_sectors, idx);
+	journal_write (fat_fs->bs.fat_start + idx, (uint8_t *) fat_fs->fat + ofs,
+	               0, bytes < DISK_SECTOR_SIZE ? bytes : DISK_SECTOR_SIZE);
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
- * Returns 0 if fails to allocate a new cluster. */
+ * Returns 0 if fails to allocate a new cluster.
+ * The search is next fit: it starts right after CLST, so a
+ * growing file stays contiguous where it can, or where the last
+ * new chain was started. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	size_t start, new;
+
+	fs_lock_acquire (&fat_fs->write_lock, FS_LOCK_ALLOC);
+	start = clst != 0 ? clst + 1 : fat_fs->last_clst;
+	new = bitmap_scan (fat_fs->free_clusters, start, 1, true);
+	if (new == BITMAP_ERROR)
+		new = bitmap_scan (fat_fs->free_clusters, 0, 1, true);
+	if (new != BITMAP_ERROR) {
+		fat_set (new, EOChain);
+		if (clst != 0)
+			fat_set (clst, new);
+		fat_fs->last_clst = new + 1;
+	}
+	fs_lock_release (&fat_fs->write_lock, FS_LOCK_ALLOC);
+	return new != BITMAP_ERROR ? new : 0;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	fs_lock_acquire (&fat_fs->write_lock, FS_LOCK_ALLOC);
+	if (pclst != 0)
+		fat_set (pclst, EOChain);
+	while (clst != EOChain) {
+		cluster_t next = fat_fs->fat[clst];
+		ASSERT (next != 0);
+		fat_set (clst, 0);
+		clst = next;
+	}
+	fs_lock_release (&fat_fs->write_lock, FS_LOCK_ALLOC);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	fs_lock_acquire (&fat_fs->write_lock, FS_LOCK_ALLOC);
+	fat_set (clst, val);
+	fs_lock_release (&fat_fs->write_lock, FS_LOCK_ALLOC);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts SECTOR, the first sector of a cluster, back to the
+ * cluster's number. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	ASSERT ((sector - fat_fs->data_start) % SECTORS_PER_CLUSTER == 0);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
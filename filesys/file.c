@@ -1,19 +1,192 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "devices/disk.h"
 #include "threads/malloc.h"
 
 #include "threads/synch.h"
 
 // static struct lock file_lock;
 
+/* Readahead window limits, in sectors. */
+#define RA_MIN 4
+#define RA_MAX 32
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+
+	/* Sequential readahead. */
+	off_t ra_next;              /* Offset a sequential read starts at. */
+	off_t ra_end;               /* End of the range already prefetched. */
+	int ra_window;              /* Sectors to read ahead; 0 if random. */
+
+	/* Pipes have no inode. */
+	struct pipe *pipe;          /* Pipe, or null for a regular file. */
+	bool write_end;             /* Write end of PIPE? */
 };
 
+/* Bytes a pipe buffers before writers block. */
+#define PIPE_SIZE 512
+
+/* A pipe shared by the files for its two ends. */
+struct pipe {
+	struct lock lock;           /* Protects the members below. */
+	struct condition readable;  /* Signaled when data or EOF arrives. */
+	struct condition writable;  /* Signaled when room appears. */
+	unsigned readers, writers;  /* Open files for each end. */
+	size_t head, used;          /* Ring buffer of pending bytes. */
+	char buf[PIPE_SIZE];
+};
+
+/* Updates FILE's readahead state after reading SIZE bytes at POS.
+ * Each read that continues where the previous one stopped
+ * doubles the readahead window, up to RA_MAX sectors, and asks
+ * for the window beyond the read to be prefetched.  Any other
+ * read closes the window. */
+static void
+file_readahead (struct file *file, off_t pos, off_t size) {
+	off_t start, end;
+
+	if (pos == file->ra_next && size > 0) {
+		file->ra_window = file->ra_window == 0 ? RA_MIN
+			: file->ra_window * 2 < RA_MAX ? file->ra_window * 2 : RA_MAX;
+	} else {
+		file->ra_window = 0;
+		file->ra_end = 0;
+	}
+	file->ra_next = pos + size;
+	if (file->ra_window == 0)
+		return;
+
+	start = file->ra_end > pos + size ? file->ra_end : pos + size;
+	end = pos + size + file->ra_window * DISK_SECTOR_SIZE;
+	if (start < end) {
+		inode_readahead (file->inode, start, end - start);
+		file->ra_end = end;
+	}
+}
+
+/* Reads SIZE bytes at OFS of FILE into BUFFER, through the page
+ * cache unless FILE is metadata.  A pipe has no offsets to read
+ * at, so this fails with -1. */
+static off_t
+read_at (struct file *file, void *buffer, off_t size, off_t ofs) {
+	if (file->pipe != NULL)
+		return -1;
+	if (inode_is_meta (file->inode))
+		return inode_read_at (file->inode, buffer, size, ofs);
+	return page_cache_read (file->inode, buffer, size, ofs);
+}
+
+/* Writes SIZE bytes from BUFFER at OFS of FILE and brings the page
+ * cache up to date.  Fails with -1 for a pipe. */
+static off_t
+write_at (struct file *file, const void *buffer, off_t size, off_t ofs) {
+	off_t written;
+
+	if (file->pipe != NULL)
+		return -1;
+	written = inode_write_at (file->inode, buffer, size, ofs);
+
+	if (!inode_is_meta (file->inode))
+		page_cache_wrote (file->inode, buffer, written, ofs);
+	return written;
+}
+
+/* Opens a file for the read end of PIPE, or its write end if
+ * WRITE_END. */
+static struct file *
+pipe_open_end (struct pipe *pipe, bool write_end) {
+	struct file *file = calloc (1, sizeof *file);
+
+	if (file == NULL)
+		return NULL;
+	file->pipe = pipe;
+	file->write_end = write_end;
+	lock_acquire (&pipe->lock);
+	if (write_end)
+		pipe->writers++;
+	else
+		pipe->readers++;
+	lock_release (&pipe->lock);
+	return file;
+}
+
+/* Drops a file for one end of PIPE, freeing PIPE with the last
+ * one.  Closing the last writer gives readers end of file, and
+ * closing the last reader stops writers. */
+static void
+pipe_close_end (struct pipe *pipe, bool write_end) {
+	bool last;
+
+	lock_acquire (&pipe->lock);
+	if (write_end)
+		pipe->writers--;
+	else
+		pipe->readers--;
+	cond_broadcast (&pipe->readable, &pipe->lock);
+	cond_broadcast (&pipe->writable, &pipe->lock);
+	last = pipe->readers == 0 && pipe->writers == 0;
+	lock_release (&pipe->lock);
+	if (last)
+		free (pipe);
+}
+
+/* Reads up to SIZE bytes from the pipe FILE reads from, waiting
+ * until there is at least one.  Returns 0 at end of file, or -1
+ * if FILE is the write end. */
+static off_t
+pipe_read (struct file *file, void *buffer, off_t size) {
+	struct pipe *pipe = file->pipe;
+	char *dst = buffer;
+	off_t n = 0;
+
+	if (file->write_end)
+		return -1;
+	if (size <= 0)
+		return 0;
+	lock_acquire (&pipe->lock);
+	while (pipe->used == 0 && pipe->writers > 0)
+		cond_wait (&pipe->readable, &pipe->lock);
+	while (n < size && pipe->used > 0) {
+		dst[n++] = pipe->buf[pipe->head];
+		pipe->head = (pipe->head + 1) % PIPE_SIZE;
+		pipe->used--;
+	}
+	cond_broadcast (&pipe->writable, &pipe->lock);
+	lock_release (&pipe->lock);
+	return n;
+}
+
+/* Writes SIZE bytes to the pipe FILE writes to, waiting for
+ * readers to make room as needed.  Stops short if the last
+ * reader goes away.  Returns -1 if FILE is the read end. */
+static off_t
+pipe_write (struct file *file, const void *buffer, off_t size) {
+	struct pipe *pipe = file->pipe;
+	const char *src = buffer;
+	off_t n = 0;
+
+	if (!file->write_end)
+		return -1;
+	lock_acquire (&pipe->lock);
+	while (n < size && pipe->readers > 0) {
+		while (n < size && pipe->used < PIPE_SIZE) {
+			pipe->buf[(pipe->head + pipe->used) % PIPE_SIZE] = src[n++];
+			pipe->used++;
+		}
+		cond_broadcast (&pipe->readable, &pipe->lock);
+		if (n < size)
+			cond_wait (&pipe->writable, &pipe->lock);
+	}
+	lock_release (&pipe->lock);
+	return n;
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
@@ -48,7 +221,11 @@ file_reopen (struct file *file) {
  * same inode as FILE. Returns a null pointer if unsuccessful. */
 struct file *
 file_duplicate (struct file *file) {
-	struct file *nfile = file_open (inode_reopen (file->inode));
+	struct file *nfile;
+
+	if (file->pipe != NULL)
+		return pipe_open_end (file->pipe, file->write_end);
+	nfile = file_open (inode_reopen (file->inode));
 	if (nfile) {
 		nfile->pos = file->pos;
 		if (file->deny_write)
@@ -57,10 +234,58 @@ file_duplicate (struct file *file) {
 	return nfile;
 }
 
+/* Creates a pipe and opens files for its read end, in ENDS[0],
+ * and its write end, in ENDS[1].  Returns false if memory runs
+ * out. */
+bool
+file_pipe (struct file *ends[2]) {
+	struct pipe *pipe = calloc (1, sizeof *pipe);
+
+	if (pipe == NULL)
+		return false;
+	lock_init (&pipe->lock);
+	cond_init (&pipe->readable);
+	cond_init (&pipe->writable);
+
+	ends[0] = pipe_open_end (pipe, false);
+	ends[1] = ends[0] != NULL ? pipe_open_end (pipe, true) : NULL;
+	if (ends[1] == NULL) {
+		if (ends[0] != NULL)
+			file_close (ends[0]);
+		else
+			free (pipe);
+		return false;
+	}
+	return true;
+}
+
+/* Returns true if FILE is one end of a pipe. */
+bool
+file_is_pipe (struct file *file) {
+	return file->pipe != NULL;
+}
+
+/* Returns true if FILE can be read: any file except the write end
+ * of a pipe. */
+bool
+file_can_read (struct file *file) {
+	return file->pipe == NULL || !file->write_end;
+}
+
+/* Returns true if FILE can be written: any file except the read
+ * end of a pipe.  (Writes may still be denied, see
+ * file_deny_write().) */
+bool
+file_can_write (struct file *file) {
+	return file->pipe == NULL || file->write_end;
+}
+
 /* Closes FILE. */
 void
 file_close (struct file *file) {
 	if (file != NULL) {
+		if (file->pipe != NULL)
+			pipe_close_end (file->pipe, file->write_end);
 		file_allow_write (file);
 		inode_close (file->inode);
 		free (file);
@@ -80,7 +305,12 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read;
+
+	if (file->pipe != NULL)
+		return pipe_read (file, buffer, size);
+	bytes_read = read_at (file, buffer, size, file->pos);
+	file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -92,19 +322,22 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	return read_at (file, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
-	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+	off_t bytes_written;
+
+	if (file->pipe != NULL)
+		return pipe_write (file, buffer, size);
+	bytes_written = write_at (file, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -112,14 +345,13 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
-	return inode_write_at (file->inode, buffer, size, file_ofs);
+	return write_at (file, buffer, size, file_ofs);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -149,7 +381,7 @@ file_allow_write (struct file *file) {
 off_t
 file_length (struct file *file) {
 	ASSERT (file != NULL);
-	return inode_length (file->inode);
+	return file->pipe != NULL ? 0 : inode_length (file->inode);
 }
 
 /* Sets the current position in FILE to NEW_POS bytes from the
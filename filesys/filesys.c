@@ -6,17 +6,19 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #include "devices/disk.h"
 
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;    
 static void do_format (void);
 
-/* file create, open, read, write, delete 시 lock으로 동시성 해결
- * inode 구조체와 같이 공통적으로 넣어줄만한 게 없음.. 추적 불가  */
-static struct lock file_lock;
+/* Root directory for threads without a process. */
+static struct dir *root_dir;
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -26,24 +28,30 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
+	page_cache_init ();
 	inode_init ();
-	lock_init(&file_lock);
+	dir_init ();
 
 #ifdef EFILESYS
 	fat_init ();
+	journal_init (format);
 
 	if (format)
 		do_format ();
 
 	fat_open ();
+	root_dir = dir_open_root ();
 #else
 	/* Original FS */
 	free_map_init ();
+	journal_init (format);
 
 	if (format)
 		do_format ();
 
 	free_map_open ();
+	root_dir = dir_open_root ();
 #endif
 }
 
@@ -51,33 +59,81 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+	dir_close (root_dir);
+	root_dir = NULL;
+	journal_done ();
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
 #endif
+	buffer_cache_flush ();
+}
+
+/* Acquires LOCK, which has rank RANK in the file system lock
+ * order. */
+void
+fs_lock_acquire (struct lock *lock, enum fs_lock_rank rank) {
+	struct thread *t = thread_current ();
+
+	ASSERT ((t->fs_locks_held >> rank) == 0);
+	lock_acquire (lock);
+	t->fs_locks_held |= 1u << rank;
+}
+
+/* Releases LOCK, which was acquired with fs_lock_acquire() at
+ * RANK. */
+void
+fs_lock_release (struct lock *lock, enum fs_lock_rank rank) {
+	struct thread *t = thread_current ();
+
+	ASSERT (t->fs_locks_held & (1u << rank));
+	t->fs_locks_held &= ~(1u << rank);
+	lock_release (lock);
+}
+
+/* Returns the running thread's working directory, which names
+ * are looked up in, or a null pointer if it cannot be opened.
+ * Without subdirectories this is always the root, but it is opened
+ * once per process and kept until the process exits instead of
+ * being reopened on every call.  Kernel threads have no process to
+ * close it, and some never exit, so unless they were handed a
+ * directory they share ROOT_DIR instead.  The caller must not
+ * close it. */
+static struct dir *
+current_dir (void) {
+	struct thread *t = thread_current ();
+
+	if (t->cwd == NULL && t->pml4 == NULL)
+		return root_dir;
+	if (t->cwd == NULL)
+		t->cwd = dir_open_root ();
+	return t->cwd;
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
  * Returns true if successful, false otherwise.
  * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
+ * or if internal memory allocation fails.
+ * The inode goes in its directory's allocation group. */
 bool
 filesys_create (const char *name, off_t initial_size) {
-	lock_acquire(&file_lock);
-
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
-			&& inode_create (inode_sector, initial_size)
+	struct dir *dir = current_dir ();
+	bool success;
+
+	journal_begin ();
+	success = (dir != NULL
+			&& free_map_allocate_near (inode_get_inumber (dir_get_inode (dir)),
+				&inode_sector)
+			&& inode_create (inode_sector, initial_size, false)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
-	dir_close (dir);
+	journal_end ();
 
-	lock_release(&file_lock);
 	return success;
 }
 
@@ -88,14 +144,11 @@ filesys_create (const char *name, off_t initial_size) {
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
-	lock_acquire(&file_lock);
-	struct dir *dir = dir_open_root ();
+	struct dir *dir = current_dir ();
 	struct inode *inode = NULL;
 
 	if (dir != NULL)
 		dir_lookup (dir, name, &inode);
-	dir_close (dir);
-	lock_release(&file_lock);
 	return file_open (inode);
 }
 
@@ -105,11 +158,12 @@ filesys_open (const char *name) {
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	lock_acquire(&file_lock);
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
-	dir_close (dir);
-	lock_release(&file_lock);
+	struct dir *dir = current_dir ();
+	bool success;
+
+	journal_begin ();
+	success = dir != NULL && dir_remove (dir, name);
+	journal_end ();
 	return success;
 }
 
@@ -117,10 +171,13 @@ filesys_remove (const char *name) {
 static void
 do_format (void) {
 	printf ("Formatting file system...");
+	journal_begin ();
 
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
@@ -128,6 +185,7 @@ do_format (void) {
 		PANIC ("root directory creation failed");
 	free_map_close ();
 #endif
+	journal_end ();
 
 	printf ("done.\n");
 }
@@ -1,12 +1,38 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects the free map and below. */
+
+#ifndef EFILESYS
+/* Allocation groups.  The disk is divided into groups of
+ * GROUP_SECTORS sectors, and group_free[] counts the sectors in
+ * each that are neither allocated nor reserved, so a search skips
+ * a full group without looking at its bits.  Allocation aims for a
+ * goal sector: a new inode goes in its directory's group, and a
+ * file's data near what it already has.
+ *
+ * Reservations live only in memory.  busy_map is free_map plus
+ * reserved sectors; only free_map is written to disk, so a crash
+ * loses no space to reservations. */
+#define GROUP_SECTORS 512       /* Sectors per allocation group. */
+#define RSV_SECTORS 8           /* Sectors reserved for a growing file. */
+
+static struct bitmap *busy_map;      /* Allocated or reserved sectors. */
+static size_t *group_free;           /* Sectors not busy, per group. */
+static size_t group_cnt;             /* Number of groups. */
+
+static void rebuild_summary (void);
+#endif
 
 /* Initializes the free map. */
 void
@@ -16,33 +42,244 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+	lock_init (&free_map_lock);
+
+#ifndef EFILESYS
+	busy_map = bitmap_create (bitmap_size (free_map));
+	group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+	group_free = malloc (group_cnt * sizeof *group_free);
+	if (busy_map == NULL || group_free == NULL)
+		PANIC ("free map allocation failed");
+	rebuild_summary ();
+#endif
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
- * Returns true if successful, false if all sectors were
- * available. */
+#ifdef EFILESYS
+/* With EFILESYS the FAT tracks free space.  A lone sector, such
+ * as an inode, is a chain of one cluster. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
+	cluster_t clst;
+
+	ASSERT (cnt == 1 && SECTORS_PER_CLUSTER == 1);
+	clst = fat_create_chain (0);
+	if (clst == 0)
+		return false;
+	*sectorp = cluster_to_sector (clst);
+	return true;
+}
+
+/* The FAT places new chains itself, so GOAL is only a hint it
+ * does not take. */
+bool
+free_map_allocate_near (disk_sector_t goal UNUSED, disk_sector_t *sectorp) {
+	return free_map_allocate (1, sectorp);
+}
+
+void
+free_map_release (disk_sector_t sector, size_t cnt) {
+	ASSERT (cnt == 1);
+	fat_remove_chain (sector_to_cluster (sector), 0);
+}
+#else
+/* Recomputes busy_map and group_free from free_map.  There must
+ * be no reservations. */
+static void
+rebuild_summary (void) {
+	size_t i, g;
+
+	for (i = 0; i < bitmap_size (free_map); i++)
+		bitmap_set (busy_map, i, bitmap_test (free_map, i));
+	for (g = 0; g < group_cnt; g++) {
+		size_t start = g * GROUP_SECTORS;
+		size_t cnt = bitmap_size (free_map) - start;
+
+		if (cnt > GROUP_SECTORS)
+			cnt = GROUP_SECTORS;
+		group_free[g] = bitmap_count (busy_map, start, cnt, false);
+	}
+}
+
+/* Marks CNT sectors starting at SECTOR busy or not, keeping the
+ * group summary in step. */
+static void
+set_busy (disk_sector_t sector, size_t cnt, bool busy) {
+	size_t i;
+
+	for (i = sector; i < sector + cnt; i++) {
+		ASSERT (bitmap_test (busy_map, i) != busy);
+		bitmap_set (busy_map, i, busy);
+		if (busy)
+			group_free[i / GROUP_SECTORS]--;
+		else
+			group_free[i / GROUP_SECTORS]++;
+	}
+}
+
+/* Returns the first run of CNT sectors that are not busy within
+ * sectors START through END - 1, or BITMAP_ERROR. */
+static size_t
+scan_range (size_t start, size_t end, size_t cnt) {
+	size_t run = 0, i;
+
+	for (i = start; i < end; i++) {
+		run = bitmap_test (busy_map, i) ? 0 : run + 1;
+		if (run == cnt)
+			return i + 1 - cnt;
+	}
+	return BITMAP_ERROR;
+}
+
+/* Finds CNT consecutive sectors that are not busy, as soon after
+ * GOAL as possible: first in GOAL's group, then in the following
+ * groups, wrapping around.  Groups whose summary shows too few
+ * free sectors are skipped.  Returns BITMAP_ERROR if there is no
+ * such run. */
+static size_t
+find_free (disk_sector_t goal, size_t cnt) {
+	size_t size = bitmap_size (busy_map);
+	size_t g0, i;
+
+	if (goal >= size)
+		goal = 0;
+	g0 = goal / GROUP_SECTORS;
+	for (i = 0; i <= group_cnt; i++) {
+		size_t g = (g0 + i) % group_cnt;
+		size_t start = g * GROUP_SECTORS;
+		size_t end = start + GROUP_SECTORS < size ? start + GROUP_SECTORS : size;
+		size_t found;
+
+		if (group_free[g] < cnt)
+			continue;
+		if (i == 0)
+			start = goal;
+		else if (i == group_cnt && goal + cnt - 1 < end)
+			end = goal + cnt - 1;
+		found = scan_range (start, end, cnt);
+		if (found != BITMAP_ERROR)
+			return found;
+	}
+	return BITMAP_ERROR;
+}
+
+/* Marks CNT sectors starting at SECTOR allocated, both in memory
+ * and on disk.  They must already be busy.  Only the part of the
+ * free map file that changed is written.  Returns false, and
+ * undoes the change, if the free map cannot be written. */
+static bool
+commit_alloc (disk_sector_t sector, size_t cnt) {
+	bitmap_set_multiple (free_map, sector, cnt, true);
+	if (free_map_file != NULL
+			&& !bitmap_write_range (free_map, free_map_file, sector, cnt)) {
 		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+		return false;
+	}
+	return true;
+}
+
+/* Allocates CNT consecutive sectors, as close after GOAL as
+ * possible, and stores the first into *SECTORP.  Returns true if
+ * successful, false if no such run is free. */
+static bool
+allocate (disk_sector_t goal, size_t cnt, disk_sector_t *sectorp) {
+	size_t sector;
+
+	fs_lock_acquire (&free_map_lock, FS_LOCK_ALLOC);
+	sector = find_free (goal, cnt);
+	if (sector != BITMAP_ERROR) {
+		set_busy (sector, cnt, true);
+		if (!commit_alloc (sector, cnt)) {
+			set_busy (sector, cnt, false);
+			sector = BITMAP_ERROR;
+		}
 	}
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
+	fs_lock_release (&free_map_lock, FS_LOCK_ALLOC);
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates CNT consecutive sectors from the free map and stores
+ * the first into *SECTORP.
+ * Returns true if successful, false if all sectors were
+ * available. */
+bool
+free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
+	return allocate (0, cnt, sectorp);
+}
+
+/* Allocates one sector as close after GOAL as possible, which
+ * keeps it in GOAL's allocation group if that has room, and
+ * stores it into *SECTORP.  Returns false if the disk is full. */
+bool
+free_map_allocate_near (disk_sector_t goal, disk_sector_t *sectorp) {
+	return allocate (goal, 1, sectorp);
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	fs_lock_acquire (&free_map_lock, FS_LOCK_ALLOC);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	set_busy (sector, cnt, false);
+	bitmap_write_range (free_map, free_map_file, sector, cnt);
+	fs_lock_release (&free_map_lock, FS_LOCK_ALLOC);
+}
+
+/* Initializes RSV as an empty reservation that will look for
+ * sectors after GOAL. */
+void
+free_map_rsv_init (struct free_map_rsv *rsv, disk_sector_t goal) {
+	rsv->start = goal;
+	rsv->cnt = 0;
+}
+
+/* Allocates a sector from RSV and stores it into *SECTORP.  If RSV
+ * is used up, first reserves a new run of up to RSV_SECTORS
+ * sectors as close after the old one as possible.  Returns false
+ * if the disk is full. */
+bool
+free_map_allocate_rsv (struct free_map_rsv *rsv, disk_sector_t *sectorp) {
+	bool success = true;
+
+	fs_lock_acquire (&free_map_lock, FS_LOCK_ALLOC);
+	if (rsv->cnt == 0) {
+		size_t cnt, sector;
+
+		for (cnt = RSV_SECTORS; cnt > 0; cnt /= 2) {
+			sector = find_free (rsv->start, cnt);
+			if (sector != BITMAP_ERROR) {
+				set_busy (sector, cnt, true);
+				rsv->start = sector;
+				rsv->cnt = cnt;
+				break;
+			}
+		}
+	}
+	if (rsv->cnt == 0 || !commit_alloc (rsv->start, 1))
+		success = false;
+	else {
+		*sectorp = rsv->start++;
+		rsv->cnt--;
+	}
+	fs_lock_release (&free_map_lock, FS_LOCK_ALLOC);
+	return success;
+}
+
+/* Returns the unused sectors of RSV to the free pool.  RSV stays
+ * usable, and will look for new sectors where it left off. */
+void
+free_map_rsv_release (struct free_map_rsv *rsv) {
+	if (rsv->cnt == 0)
+		return;
+	fs_lock_acquire (&free_map_lock, FS_LOCK_ALLOC);
+	set_busy (rsv->start, rsv->cnt, false);
+	rsv->cnt = 0;
+	fs_lock_release (&free_map_lock, FS_LOCK_ALLOC);
 }
+#endif
 
 /* Opens the free map file and reads it from disk. */
 void
@@ -52,6 +289,9 @@ free_map_open (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+#ifndef EFILESYS
+	rebuild_summary ();
+#endif
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -65,7 +305,7 @@ free_map_close (void) {
 void
 free_map_create (void) {
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), true))
 		PANIC ("free map creation failed");
 
 	/* Write bitmap to file. */
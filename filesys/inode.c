@@ -1,10 +1,15 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 
 #include "threads/synch.h"
@@ -12,16 +17,93 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-static struct lock file_lock;
+/* Inode flags. */
+#define INODE_META 0x1          /* Contents are journaled metadata. */
+#define INODE_INLINE 0x2        /* Data is stored in the inode itself. */
+
+/* Locking.  inode_table_lock protects the inode table below and
+ * each inode's open_cnt and deny_write_cnt.  An inode's grow_lock
+ * protects its block index, length, and either its chain cursors
+ * (with EFILESYS) or its reservation; data sectors themselves are
+ * protected by the buffer cache.  Reads and overwrites of allocated sectors take neither,
+ * so I/O on one file never waits for another.  See enum
+ * fs_lock_rank for the order. */
+static struct lock inode_table_lock;
+
+#ifdef EFILESYS
+/* Data lives in a FAT cluster chain that starts at START, or
+ * nowhere if START is 0.  Chains have no holes: extending a file
+ * past its end fills the gap with zeroed clusters.  A new file's
+ * chain is not allocated up front, since there is nowhere to mark
+ * clusters unwritten; bytes past the end of the chain read as
+ * zeros instead. */
+#define CLUSTER_SIZE (DISK_SECTOR_SIZE * SECTORS_PER_CLUSTER)
+
+/* A known position in a file's chain: cluster CLST is cluster
+ * number IDX of the file.  CLST is 0 if the cursor is unused. */
+struct chain_cursor {
+	size_t idx;
+	cluster_t clst;
+};
+
+/* Cursors kept per inode.  More than one, so that readahead
+ * running ahead of a reader does not send the reader back to the
+ * start of the chain. */
+#define CHAIN_CURSORS 2
+
+/* Chains have no unwritten clusters. */
+#define UNWRITTEN 0
+
+/* Bytes of data an INODE_INLINE file keeps in its inode. */
+#define INLINE_MAX 496
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk {
+	cluster_t start;                    /* First data cluster. */
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t flags;                     /* INODE_* flags. */
+	uint8_t inline_data[INLINE_MAX];    /* Data, if INODE_INLINE. */
+};
+#else
+/* Data sectors are found through a multi-level index.  The
+ * first DIRECT_CNT sectors of a file are listed in the inode
+ * itself, the next PTRS_PER_SECTOR in the indirect sector, and
+ * the next PTRS_PER_SECTOR * PTRS_PER_SECTOR through the doubly
+ * indirect sector, which lists indirect sectors.  A pointer of 0
+ * is a hole: nothing is allocated there and it reads as zeros.
+ * Sector 0 holds the free map inode, so it is never a data or
+ * index sector.  A data pointer with UNWRITTEN set names a sector
+ * that is allocated but has never been written, which also reads
+ * as zeros; it is zeroed when first written.  Sector numbers are
+ * far below that bit. */
+#define DIRECT_CNT 123
+#define UNWRITTEN 0x80000000u
+#define PTRS_PER_SECTOR ((size_t) (DISK_SECTOR_SIZE / sizeof (disk_sector_t)))
+
+/* Bytes of data an INODE_INLINE file keeps in its inode, in place
+ * of the direct pointers. */
+#define INLINE_MAX (DIRECT_CNT * sizeof (disk_sector_t))
+
+/* Largest file size, in sectors. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+		+ PTRS_PER_SECTOR * PTRS_PER_SECTOR)
 
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	union {
+		disk_sector_t direct[DIRECT_CNT];   /* Direct data sectors. */
+		uint8_t inline_data[INLINE_MAX];    /* Data, if INODE_INLINE. */
+	};
+	disk_sector_t indirect;             /* Indirect index sector. */
+	disk_sector_t doubly_indirect;      /* Doubly indirect index sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t flags;                     /* INODE_* flags. */
 };
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -30,51 +112,444 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Returns true if the data of the file whose on-disk inode is DATA
+ * is metadata, such as a directory or the free map. */
+static inline bool
+is_meta (const struct inode_disk *data) {
+	return (data->flags & INODE_META) != 0;
+}
+
+/* Returns true if the file whose on-disk inode is DATA keeps its
+ * data inline.  A file stops being inline when it outgrows
+ * INLINE_MAX and never becomes inline again, so a false result
+ * needs no lock. */
+static inline bool
+is_inline (const struct inode_disk *data) {
+	return (data->flags & INODE_INLINE) != 0;
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR at byte OFS, through
+ * the journal if the sector holds metadata (META), otherwise
+ * straight to the buffer cache. */
+static void
+sector_write (disk_sector_t sector, const void *buffer, int ofs, int size,
+		bool meta) {
+	if (meta)
+		journal_write (sector, buffer, ofs, size);
+	else
+		buffer_cache_write (sector, buffer, ofs, size);
+}
+
+/* Fills SECTOR, just allocated, with zeros.  A sector for file data
+ * may have been logged as metadata before, so it is revoked, and
+ * it must reach the disk before the pointer that makes it
+ * readable commits. */
+static void
+zero_sector (disk_sector_t sector, bool meta) {
+	static char zeros[DISK_SECTOR_SIZE];
+
+	if (!meta)
+		journal_revoke (sector);
+	sector_write (sector, zeros, 0, DISK_SECTOR_SIZE, meta);
+	if (!meta)
+		journal_order (sector);
+}
+
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in inode_table. */
+	struct list_elem lru_elem;          /* Element in unused_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct lock grow_lock;              /* Protects index and length. */
+	struct lock dir_lock;               /* Directory entries, if a dir. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	struct chain_cursor cursors[CHAIN_CURSORS]; /* Recent positions. */
+#else
+	struct free_map_rsv rsv;            /* Sectors set aside to grow into. */
+#endif
 
 	// struct lock read_lock;
 	// struct semaphore write_sema;
 	// int read_cnt;
 };
 
+#ifdef EFILESYS
+/* Appends a zeroed cluster to the chain that ends at CLST, or
+ * starts a new chain if CLST is 0.  META is true if the chain
+ * holds metadata.  Returns the new cluster, or 0 if the disk is
+ * full. */
+static cluster_t
+append_cluster (cluster_t clst, bool meta) {
+	cluster_t new = fat_create_chain (clst);
+	int i;
+
+	if (new != 0)
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+			zero_sector (cluster_to_sector (new) + i, meta);
+	return new;
+}
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
- * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * INODE, or 0 if the chain does not reach that far.  If CREATE is
+ * true, extends the chain first; then 0 means the disk is full.
+ * The walk resumes from the nearest cursor at or before POS, so
+ * sequential access costs O(1) per cluster. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos, bool create) {
+	struct chain_cursor *cur, *c;
+	size_t idx = pos / CLUSTER_SIZE;
+	size_t i;
+	cluster_t clst;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
+	fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+	if (inode->data.start == 0) {
+		if (create)
+			inode->data.start = append_cluster (0, is_meta (&inode->data));
+		if (inode->data.start == 0) {
+			fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+			return 0;
+		}
+		journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	}
+
+	cur = NULL;
+	for (c = inode->cursors; c < inode->cursors + CHAIN_CURSORS; c++)
+		if (c->clst != 0 && c->idx <= idx && (cur == NULL || c->idx > cur->idx))
+			cur = c;
+	if (cur != NULL) {
+		i = cur->idx;
+		clst = cur->clst;
+	} else {
+		/* Walk from the head, replacing a free cursor or else the
+		 * one farthest along. */
+		cur = inode->cursors;
+		for (c = inode->cursors; c < inode->cursors + CHAIN_CURSORS; c++)
+			if (cur->clst != 0 && (c->clst == 0 || c->idx > cur->idx))
+				cur = c;
+		i = 0;
+		clst = inode->data.start;
+	}
+
+	for (; i < idx; i++) {
+		cluster_t next = fat_get (clst);
+		if (next == EOChain && (!create
+					|| (next = append_cluster (clst, is_meta (&inode->data))) == 0))
+			break;
+		clst = next;
+	}
+	cur->idx = i;
+	cur->clst = clst;
+	fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+
+	if (i < idx)
+		return 0;
+	return cluster_to_sector (clst) + pos % CLUSTER_SIZE / DISK_SECTOR_SIZE;
+}
+
+/* Gives INODE, which has no data blocks, a zeroed first cluster,
+ * and returns its first sector, or 0 if the disk is full.  The
+ * caller must hold INODE's grow_lock and write its inode back. */
+static disk_sector_t
+allocate_first (struct inode *inode) {
+	inode->data.start = append_cluster (0, is_meta (&inode->data));
+	return inode->data.start != 0 ? cluster_to_sector (inode->data.start) : 0;
+}
+
+/* Gives the new file whose on-disk inode is DATA, in sector
+ * SECTOR, a chain of SECTORS sectors if it holds metadata.  Other
+ * files get their chain as they are written.  Returns false if
+ * the disk is full. */
+static bool
+allocate_initial (struct inode_disk *data, disk_sector_t sector UNUSED,
+		size_t sectors) {
+	size_t clusters = DIV_ROUND_UP (sectors, SECTORS_PER_CLUSTER);
+	cluster_t clst = 0;
+	size_t i;
+
+	if (!is_meta (data))
+		return true;
+	for (i = 0; i < clusters; i++) {
+		clst = append_cluster (clst, is_meta (data));
+		if (clst == 0)
+			return false;
+		if (data->start == 0)
+			data->start = clst;
+	}
+	return true;
+}
+
+/* Frees the cluster chain of the file whose on-disk inode is
+ * DATA. */
+static void
+release_blocks (struct inode_disk *data) {
+	if (data->start != 0)
+		fat_remove_chain (data->start, 0);
+	data->start = 0;
+}
+#else
+/* What a sector allocated for an index pointer will hold. */
+enum sector_kind {
+	SECTOR_META,            /* Metadata, zeroed through the journal. */
+	SECTOR_DATA,            /* File data, zeroed in the buffer cache. */
+	SECTOR_UNWRITTEN,       /* File data, left unwritten. */
+};
+
+/* Returns the kind of sector that holds data of the file whose
+ * on-disk inode is DATA. */
+static inline enum sector_kind
+data_kind (const struct inode_disk *data) {
+	return is_meta (data) ? SECTOR_META : SECTOR_DATA;
+}
+
+/* Returns the new value for an index pointer that holds SECTOR,
+ * which is about to be used for KIND: a hole gets a sector from
+ * RSV, and an unwritten sector that is about to be written is
+ * zeroed first.  Returns 0 if the disk is full. */
+static disk_sector_t
+fill_pointer (disk_sector_t sector, struct free_map_rsv *rsv,
+		enum sector_kind kind) {
+	if (sector == 0) {
+		if (!free_map_allocate_rsv (rsv, &sector))
+			return 0;
+		if (kind == SECTOR_UNWRITTEN) {
+			journal_revoke (sector);
+			return sector | UNWRITTEN;
+		}
+	} else if ((sector & UNWRITTEN) && kind != SECTOR_UNWRITTEN)
+		sector &= ~UNWRITTEN;
 	else
-		return -1;
+		return sector;
+	zero_sector (sector, kind == SECTOR_META);
+	return sector;
+}
+
+/* Returns the sector that *SLOTP points to.  If RSV is nonnull,
+ * first fills it in with fill_pointer() for KIND.  Returns 0 for a
+ * hole or if allocation fails. */
+static disk_sector_t
+slot_get_or_alloc (disk_sector_t *slotp, struct free_map_rsv *rsv,
+		enum sector_kind kind) {
+	if (rsv != NULL)
+		*slotp = fill_pointer (*slotp, rsv, kind);
+	return *slotp;
+}
+
+/* Like slot_get_or_alloc(), for entry IDX of index sector INDEX. */
+static disk_sector_t
+index_get_or_alloc (disk_sector_t index, size_t idx,
+		struct free_map_rsv *rsv, enum sector_kind kind) {
+	disk_sector_t sector, old;
+	off_t ofs = idx * sizeof sector;
+
+	buffer_cache_read (index, &sector, ofs, sizeof sector);
+	if (rsv != NULL) {
+		old = sector;
+		sector = fill_pointer (sector, rsv, kind);
+		if (sector != old && sector != 0)
+			journal_write (index, &sector, ofs, sizeof sector);
+	}
+	return sector;
+}
+
+/* Returns the data sector for sector index IDX of the file whose
+ * on-disk inode is DATA, or 0 if it is a hole.  The result may
+ * have UNWRITTEN set.  If RSV is nonnull, first fills in the data
+ * pointer for KIND, allocating it and any index sectors it needs
+ * from RSV; then 0 means the disk is full.  The caller must write
+ * DATA back if it changes. */
+static disk_sector_t
+index_to_sector (struct inode_disk *data, size_t idx,
+		struct free_map_rsv *rsv, enum sector_kind kind) {
+	disk_sector_t index;
+
+	if (idx < DIRECT_CNT)
+		return slot_get_or_alloc (&data->direct[idx], rsv, kind);
+	idx -= DIRECT_CNT;
+
+	if (idx < PTRS_PER_SECTOR) {
+		index = slot_get_or_alloc (&data->indirect, rsv, SECTOR_META);
+		return index != 0 ? index_get_or_alloc (index, idx, rsv, kind) : 0;
+	}
+	idx -= PTRS_PER_SECTOR;
+
+	if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR) {
+		index = slot_get_or_alloc (&data->doubly_indirect, rsv, SECTOR_META);
+		if (index != 0)
+			index = index_get_or_alloc (index, idx / PTRS_PER_SECTOR,
+					rsv, SECTOR_META);
+		if (index != 0)
+			return index_get_or_alloc (index, idx % PTRS_PER_SECTOR,
+					rsv, kind);
+	}
+	return 0;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE, or 0 if that byte lies in a hole.  The result has
+ * UNWRITTEN set if the sector has never been written.  If CREATE
+ * is true, fills the hole or zeroes the unwritten sector first;
+ * then 0 means the disk is full. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos, bool create) {
+	struct inode_disk before;
+	disk_sector_t sector;
+
+	ASSERT (inode != NULL);
+
+	/* Index pointers only ever change from 0 to a zeroed sector, or
+	 * from unwritten to zeroed, so one that is already set can be
+	 * used without the lock. */
+	sector = index_to_sector (&inode->data, pos / DISK_SECTOR_SIZE,
+			NULL, SECTOR_DATA);
+	if ((sector != 0 && !(sector & UNWRITTEN)) || !create)
+		return sector;
+
+	fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+	before = inode->data;
+	sector = index_to_sector (&inode->data, pos / DISK_SECTOR_SIZE,
+			&inode->rsv, data_kind (&inode->data));
+	if (memcmp (&before, &inode->data, sizeof before))
+		journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+	return sector;
+}
+
+/* Gives INODE, which has no data blocks, a zeroed first sector,
+ * and returns it, or 0 if the disk is full.  The caller must hold
+ * INODE's grow_lock and write its inode back. */
+static disk_sector_t
+allocate_first (struct inode *inode) {
+	return index_to_sector (&inode->data, 0, &inode->rsv,
+			data_kind (&inode->data));
+}
+
+/* Allocates the first SECTORS data sectors of the new file whose
+ * on-disk inode is DATA, in sector SECTOR.  File data is left
+ * unwritten, so this costs no data I/O however long the file;
+ * metadata is zeroed.  Returns false if the disk is full or the
+ * file would be too large. */
+static bool
+allocate_initial (struct inode_disk *data, disk_sector_t sector,
+		size_t sectors) {
+	struct free_map_rsv rsv;
+	bool success = true;
+	size_t i;
+
+	if (sectors > MAX_SECTORS)
+		return false;
+	free_map_rsv_init (&rsv, sector + 1);
+	for (i = 0; i < sectors && success; i++)
+		success = index_to_sector (data, i, &rsv,
+				is_meta (data) ? SECTOR_META : SECTOR_UNWRITTEN) != 0;
+	free_map_rsv_release (&rsv);
+	return success;
+}
+
+/* Frees the sectors listed in index sector INDEX, which is
+ * LEVEL levels above the data, and then INDEX itself. */
+static void
+release_index (disk_sector_t index, int level) {
+	size_t i;
+
+	index &= ~UNWRITTEN;
+	if (index == 0)
+		return;
+
+	/* Pointers are read one at a time to keep the kernel stack
+	 * small across the recursion. */
+	if (level > 0)
+		for (i = 0; i < PTRS_PER_SECTOR; i++)
+			release_index (index_get_or_alloc (index, i, NULL, SECTOR_META),
+					level - 1);
+	free_map_release (index, 1);
+}
+
+/* Frees every data and index sector of the file whose on-disk
+ * inode is DATA. */
+static void
+release_blocks (struct inode_disk *data) {
+	size_t i;
+
+	for (i = 0; i < DIRECT_CNT; i++)
+		release_index (data->direct[i], 0);
+	release_index (data->indirect, 1);
+	release_index (data->doubly_indirect, 2);
+	memset (data->direct, 0, sizeof data->direct);
+	data->indirect = data->doubly_indirect = 0;
+}
+#endif
+
+/* In-memory inodes, keyed by sector, so that opening a single
+ * inode twice returns the same `struct inode'.  Inodes whose
+ * open_cnt has dropped to 0 stay in the table, with their data
+ * still valid, on the UNUSED_INODES list, most recently closed
+ * first.  Reopening one needs no disk access.  At most UNUSED_MAX
+ * are kept, and all of them are dropped if malloc() fails.
+ * inode_table_lock protects the table and the list. */
+#define UNUSED_MAX 64
+
+static struct hash inode_table;
+static struct list unused_inodes;
+static size_t unused_cnt;
+static long long open_hit_cnt, open_miss_cnt;
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Frees the least recently closed unused inode.  Returns false if
+ * there is none.  inode_table_lock must be held. */
+static bool
+evict_unused (void) {
+	struct inode *inode;
+
+	if (list_empty (&unused_inodes))
+		return false;
+	inode = list_entry (list_pop_back (&unused_inodes), struct inode, lru_elem);
+	unused_cnt--;
+	hash_delete (&inode_table, &inode->elem);
+	page_cache_forget (inode);
+	free (inode);
+	return true;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	lock_init(&file_lock);
-	list_init (&open_inodes);
+	lock_init (&inode_table_lock);
+	hash_init (&inode_table, inode_hash, inode_less, NULL);
+	list_init (&unused_inodes);
+}
+
+/* Prints inode table statistics. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld opens from memory, %lld from disk\n",
+			open_hit_cnt, open_miss_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk.  META is true if the file's data is metadata, such as a
+ * directory or the free map, which is journaled like the inode.
+ * Other files of up to INLINE_MAX bytes start out inline.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool
-inode_create (disk_sector_t sector, off_t length) {
+inode_create (disk_sector_t sector, off_t length, bool meta) {
 	struct inode_disk *disk_inode = NULL;
 	bool success = false;
 
@@ -86,65 +561,102 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		disk_inode->flags = meta ? INODE_META : 0;
+
+		/* Allocate the initial data up front, so that files such as
+		 * the free map never need to grow.  Metadata files are never
+		 * inline, since they are written with locks held that
+		 * moving the data out would need. */
+		if (!meta && length <= (off_t) INLINE_MAX) {
+			disk_inode->flags |= INODE_INLINE;
+			success = true;
+		} else
+			success = allocate_initial (disk_inode, sector,
+					bytes_to_sectors (length));
+		if (success)
+			journal_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+		else
+			release_blocks (disk_inode);
 		free (disk_inode);
 	}
 	return success;
 }
 
+/* Returns the inode for SECTOR from the inode table, opened
+ * once more, or a null pointer if it is not there.
+ * inode_table_lock must be held. */
+static struct inode *
+inode_claim (disk_sector_t sector) {
+	struct inode key;
+	struct hash_elem *e;
+	struct inode *inode;
+
+	key.sector = sector;
+	e = hash_find (&inode_table, &key.elem);
+	if (e == NULL)
+		return NULL;
+	inode = hash_entry (e, struct inode, elem);
+	if (inode->open_cnt++ == 0) {
+		list_remove (&inode->lru_elem);
+		unused_cnt--;
+	}
+	open_hit_cnt++;
+	return inode;
+}
+
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
-	lock_acquire(&file_lock);
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			lock_release(&file_lock);
-			return inode; 
-		}
+	struct inode *inode, *other;
+
+	/* Check whether this inode is already open or still cached. */
+	fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
+	inode = inode_claim (sector);
+	if (inode != NULL) {
+		fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
+		return inode;
 	}
 
-	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL) {
-		lock_release(&file_lock);
-		return NULL;
-	}
+	/* Allocate memory, making room if need be. */
+	while ((inode = malloc (sizeof *inode)) == NULL)
+		if (!evict_unused ()) {
+			fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
+			return NULL;
+		}
+	fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize.  The sector is read without the table lock, so a
+	 * slow disk does not hold up other opens. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	
-	// inode->read_cnt = 0;
-	// lock_init(&inode->read_lock);
-	// /* 깨워줄 애가 없으니까 1로 초기화 */
-	// sema_init(&inode->write_sema, 1);
+	lock_init (&inode->grow_lock);
+	lock_init (&inode->dir_lock);
+#ifdef EFILESYS
+	memset (inode->cursors, 0, sizeof inode->cursors);
+#else
+	free_map_rsv_init (&inode->rsv, sector + 1);
+#endif
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+	/* Someone else may have opened it in the meantime. */
+	fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
+	other = inode_claim (sector);
+	if (other == NULL) {
+		hash_insert (&inode_table, &inode->elem);
+		open_miss_cnt++;
+	}
+	fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
 
-	disk_read (filesys_disk, inode->sector, &inode->data);
-	lock_release(&file_lock);
+	if (other != NULL) {
+		free (inode);
+		return other;
+	}
 	return inode;
 }
 
@@ -152,7 +664,9 @@ inode_open (disk_sector_t sector) {
 struct inode *
 inode_reopen (struct inode *inode) {
 	if (inode != NULL){
+		fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
 		inode->open_cnt++;
+		fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
 	}
 	return inode;
 }
@@ -163,27 +677,51 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
- * If this was the last reference to INODE, frees its memory.
- * If INODE was also a removed inode, frees its blocks. */
+/* Closes INODE.
+ * If this was the last reference to INODE, keeps it cached for
+ * reuse, or if INODE was also a removed inode, frees its memory
+ * and its blocks. */
 void
 inode_close (struct inode *inode) {
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
+
+#ifndef EFILESYS
+	/* Give back the sectors reserved for growth once the last
+	 * opener is done.  open_cnt is read without the table lock, so
+	 * this may happen a little early, which costs only locality. */
+	if (inode->open_cnt == 1) {
+		fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+		free_map_rsv_release (&inode->rsv);
+		fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+	}
+#endif
+
+	fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
 	/* Release resources if this was the last opener. */
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+			/* Remove from inode table and release lock. */
+			hash_delete (&inode_table, &inode->elem);
+			fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
+
+			/* Deallocate blocks. */
+			journal_begin ();
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			if (!is_inline (&inode->data))
+				release_blocks (&inode->data);
+			journal_end ();
+			page_cache_forget (inode);
+			free (inode);
+			return;
 		}
-		free (inode); 
+
+		list_push_front (&unused_inodes, &inode->lru_elem);
+		if (++unused_cnt > UNUSED_MAX)
+			evict_unused ();
 	}
+	fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -201,7 +739,21 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+
+	if (is_inline (&inode->data)) {
+		fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+		if (is_inline (&inode->data)) {
+			if (offset < inode->data.length) {
+				bytes_read = inode->data.length - offset;
+				if (bytes_read > size)
+					bytes_read = size;
+				memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+			}
+			fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+			return bytes_read;
+		}
+		fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+	}
 
 	// lock_acquire(&inode->read_lock);
 	// inode->read_cnt++;
@@ -211,7 +763,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -224,27 +775,20 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Disk sector to read, or 0 for a hole, which like an unwritten
+		 * sector reads as zeros. */
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, false);
+		if (sector_idx != 0 && !(sector_idx & UNWRITTEN))
+			buffer_cache_read (sector_idx, buffer + bytes_read,
+					sector_ofs, chunk_size);
+		else
+			memset (buffer + bytes_read, 0, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	// lock_acquire(&inode->read_lock);
 	// inode->read_cnt--;
@@ -255,66 +799,136 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	return bytes_read;
 }
 
+/* Starts reading the SIZE bytes of INODE at OFFSET into the
+ * buffer cache in the background, as far as end of file. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+
+	if (is_inline (&inode->data))
+		return;
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE); offset < end;
+			offset += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, offset, false);
+		if (sector != 0 && !(sector & UNWRITTEN))
+			buffer_cache_prefetch (sector);
+	}
+}
+
+/* Moves the data of INODE, which is inline, out to a newly
+ * allocated first block.  Readers of an inline file take
+ * grow_lock, which the caller must hold, so they never see the
+ * file half moved; the flag is cleared only once the block is in
+ * place.  Returns false if memory or disk space is short. */
+static bool
+move_inline (struct inode *inode) {
+	uint8_t *saved = malloc (INLINE_MAX);
+	disk_sector_t sector = 0;
+
+	if (saved == NULL)
+		return false;
+	memcpy (saved, inode->data.inline_data, INLINE_MAX);
+	memset (inode->data.inline_data, 0, INLINE_MAX);
+	sector = allocate_first (inode);
+	if (sector == 0) {
+		memcpy (inode->data.inline_data, saved, INLINE_MAX);
+		free (saved);
+		return false;
+	}
+	buffer_cache_write (sector, saved, 0, INLINE_MAX);
+	free (saved);
+
+	barrier ();
+	inode->data.flags &= ~INODE_INLINE;
+	journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, which was inline,
+ * starting at OFFSET, if they fit inline, and otherwise moves the
+ * data out to a block.  Returns the number of bytes written, or -1
+ * if the write must go to the file's blocks. */
+static off_t
+write_inline (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t written = -1;
+
+	fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+	if (is_inline (&inode->data)) {
+		if (offset + size <= (off_t) INLINE_MAX) {
+			memcpy (inode->data.inline_data + offset, buffer, size);
+			if (offset + size > inode->data.length)
+				inode->data.length = offset + size;
+			journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+			written = size;
+		} else if (!move_inline (inode))
+			written = 0;
+	}
+	fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+	return written;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * Writing past end of file extends the file; any gap between the
+ * old end and OFFSET is left as a hole. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	// sema_down(&inode->write_sema);
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	journal_begin ();
+	if (is_inline (&inode->data)) {
+		bytes_written = write_inline (inode, buffer, size, offset);
+		if (bytes_written >= 0) {
+			journal_end ();
+			return bytes_written;
+		}
+		bytes_written = 0;
+	}
 	while (size > 0) {
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		/* Starting byte offset within sector, bytes left in sector. */
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
-
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
 		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
-			break;
+		int chunk_size = size < sector_left ? size : sector_left;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
+		/* Sector to write, allocated if it is a hole or past end of
+		 * file.  Stop if the disk or the index is full. */
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, true);
+		if (sector_idx == 0)
+			break;
 
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		sector_write (sector_idx, buffer + bytes_written,
+				sector_ofs, chunk_size, is_meta (&inode->data));
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+
+	/* Extend the file if we wrote past its end.  Readers see the
+	 * new length only once the data is in place. */
+	if (bytes_written > 0 && offset > inode_length (inode)) {
+		fs_lock_acquire (&inode->grow_lock, FS_LOCK_INODE);
+		if (offset > inode->data.length) {
+			inode->data.length = offset;
+			journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		}
+		fs_lock_release (&inode->grow_lock, FS_LOCK_INODE);
+	}
+	journal_end ();
 	
 	// sema_up(&inode->write_sema);
 
@@ -326,8 +940,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
 }
 
 /* Re-enables writes to INODE.
@@ -335,9 +951,24 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	fs_lock_acquire (&inode_table_lock, FS_LOCK_INODE_TABLE);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	fs_lock_release (&inode_table_lock, FS_LOCK_INODE_TABLE);
+}
+
+/* Locks INODE, which must be a directory, against concurrent
+ * changes to its entries. */
+void
+inode_lock_dir (struct inode *inode) {
+	fs_lock_acquire (&inode->dir_lock, FS_LOCK_DIR);
+}
+
+/* Releases the lock taken by inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode) {
+	fs_lock_release (&inode->dir_lock, FS_LOCK_DIR);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -345,3 +976,10 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Returns true if INODE holds metadata, such as a directory,
+ * which is written only below the file layer. */
+bool
+inode_is_meta (const struct inode *inode) {
+	return is_meta (&inode->data);
+}
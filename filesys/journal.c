@@ -0,0 +1,659 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/page_cache.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+ *
+ * Every change to file system metadata (inodes, index sectors,
+ * directory blocks, and the free map or FAT) is made between
+ * journal_begin() and journal_end() and written with
+ * journal_write().  All operations that overlap in time join one
+ * running transaction, which is committed as a whole: a
+ * descriptor listing its sectors, their new contents, and a
+ * commit record go to the log in one sequential run.  After a
+ * crash, journal_init() replays every committed transaction, so
+ * each one takes effect entirely or not at all.
+ *
+ * Until its transaction commits, a logged sector's cache slot is
+ * kept clean so that it cannot reach its home location early.  The
+ * transaction holds a copy of the sector, and supplies it if the
+ * slot is evicted and read again.  At commit the copies go back to
+ * the buffer cache as ordinary dirty sectors.
+ *
+ * A transaction is committed when it grows past TX_SOFT_MAX
+ * sectors, every COMMIT_INTERVAL ticks, and at shutdown.  The log
+ * is a ring of LOG_SIZE sectors after the journal header.
+ * Checkpointing is lazy: only when the ring has no room for the
+ * next commit is the buffer cache flushed, which puts every
+ * committed sector home and empties the ring.
+ *
+ * File data is not journaled.  A sector that was logged since the
+ * last checkpoint and is then reused for file data gets a revoke
+ * record, so that replay does not overwrite the data with stale
+ * metadata.  A data sector that a transaction makes readable, by
+ * filling a hole or clearing an unwritten mark, is written home
+ * before the transaction's log records, so that a committed
+ * pointer never names whatever the sector held before.
+ *
+ * An operation too large for one transaction writes the excess
+ * sectors straight to the buffer cache, and loses atomicity.  If
+ * such a sector was logged since the last checkpoint, replay
+ * would put the logged copy back over the newer contents, so the
+ * log is checkpointed first.  The running transaction cannot
+ * commit while the operation is active, so this is safe.  An
+ * unlogged pointer can also reach the disk ahead of the data
+ * sector it names. */
+
+#define JOURNAL_MAGIC 0x4a484452        /* Journal header. */
+#define DESC_MAGIC 0x4a445343           /* Descriptor. */
+#define COMMIT_MAGIC 0x4a434d54         /* Commit record. */
+
+#define LOG_SIZE (JOURNAL_SECTORS - 1)  /* Sectors in the log ring. */
+#define DESC_ENTRIES 125                /* Entries per transaction. */
+#define TX_SOFT_MAX 64                  /* Commit beyond this many. */
+#define COMMIT_INTERVAL (5 * TIMER_FREQ) /* Ticks between commits. */
+#define REVOKED 0x80000000u             /* Descriptor entry is a revoke. */
+#define LOG_BUF_SECTORS (DESC_ENTRIES + 1) /* Descriptor and contents. */
+
+/* Journal header, in sector JOURNAL_SECTOR. */
+struct journal_header {
+	uint32_t magic;
+	uint32_t tail;                      /* Log position of oldest commit. */
+	uint32_t tail_seq;                  /* Its sequence number. */
+	uint8_t unused[DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+};
+
+/* First log sector of a transaction.  It is followed by the
+ * contents of each entry that is not a revoke, in order, and then
+ * a commit record. */
+struct descriptor {
+	uint32_t magic;
+	uint32_t seq;                       /* Transaction sequence number. */
+	uint32_t cnt;                       /* Number of entries. */
+	uint32_t sectors[DESC_ENTRIES];     /* Sector, or'd with REVOKED. */
+};
+
+/* Last log sector of a transaction. */
+struct commit_record {
+	uint32_t magic;
+	uint32_t seq;                       /* Transaction sequence number. */
+	uint8_t unused[DISK_SECTOR_SIZE - 2 * sizeof (uint32_t)];
+};
+
+/* A sector in the running transaction. */
+struct jentry {
+	struct hash_elem elem;              /* Element in tx_map. */
+	disk_sector_t sector;               /* Sector number. */
+	uint8_t *image;                     /* New contents, null if revoked. */
+	bool valid;                         /* IMAGE filled in yet? */
+};
+
+/* Running transaction.  journal_lock protects these. */
+static struct lock journal_lock;
+static struct condition journal_cond;   /* Operations or a commit ended. */
+static struct hash tx_map;              /* Entries, keyed by sector. */
+static size_t tx_cnt;                   /* Entries in tx_map. */
+static size_t tx_logged;                /* Entries that are not revokes. */
+static int active_cnt;                  /* Operations not yet ended. */
+static bool committing;                 /* Commit in progress? */
+
+/* Log ring, changed only by the committing thread. */
+static uint32_t head, tail;             /* Next free and oldest position. */
+static uint32_t next_seq, tail_seq;     /* Their sequence numbers. */
+static struct bitmap *logged_map;       /* Logged since last checkpoint. */
+static struct bitmap *ordered_map;      /* Data to write before commit. */
+static size_t ordered_cnt;              /* Bits set in ordered_map. */
+static struct lock checkpoint_lock;     /* Serializes overflow checkpoints. */
+static uint8_t *log_buf;                /* LOG_BUF_SECTORS staging sectors. */
+
+/* Statistics. */
+static long long commit_cnt, op_cnt, logged_cnt, checkpoint_cnt,
+		overflow_cnt;
+
+static void journal_format (void);
+static void journal_recover (void);
+static void committer (void *);
+
+static uint64_t
+jentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct jentry, elem)->sector);
+}
+
+static bool
+jentry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct jentry, elem)->sector
+		< hash_entry (b, struct jentry, elem)->sector;
+}
+
+static void
+jentry_free (struct hash_elem *e, void *aux UNUSED) {
+	struct jentry *je = hash_entry (e, struct jentry, elem);
+
+	free (je->image);
+	free (je);
+}
+
+/* Returns SECTOR's entry in the running transaction, or a null
+ * pointer.  journal_lock must be held. */
+static struct jentry *
+tx_find (disk_sector_t sector) {
+	struct jentry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&tx_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct jentry, elem) : NULL;
+}
+
+/* Adds SECTOR to the running transaction as a revoke.  Returns the
+ * new entry, or a null pointer if the transaction is full or
+ * memory is short.  journal_lock must be held. */
+static struct jentry *
+tx_add (disk_sector_t sector) {
+	struct jentry *e;
+
+	if (tx_cnt >= DESC_ENTRIES || (e = malloc (sizeof *e)) == NULL)
+		return NULL;
+	e->sector = sector;
+	e->image = NULL;
+	e->valid = false;
+	hash_insert (&tx_map, &e->elem);
+	tx_cnt++;
+	return e;
+}
+
+/* Returns the disk sector at log position POS. */
+static disk_sector_t
+log_sector (uint32_t pos) {
+	return JOURNAL_SECTOR + 1 + pos % LOG_SIZE;
+}
+
+/* Writes CNT sectors from BUFFER to the log starting at position
+ * POS, as one disk range or two if the run wraps around the ring. */
+static void
+log_write (uint32_t pos, size_t cnt, const void *buffer) {
+	const uint8_t *p = buffer;
+
+	while (cnt > 0) {
+		size_t n = LOG_SIZE - pos % LOG_SIZE;
+
+		if (n > cnt)
+			n = cnt;
+		disk_write_many (filesys_disk, log_sector (pos), n, p);
+		p += n * DISK_SECTOR_SIZE;
+		pos += n;
+		cnt -= n;
+	}
+}
+
+/* Reads CNT sectors of the log starting at position POS into
+ * BUFFER, as one disk range or two if the run wraps around the
+ * ring. */
+static void
+log_read (uint32_t pos, size_t cnt, void *buffer) {
+	uint8_t *p = buffer;
+
+	while (cnt > 0) {
+		size_t n = LOG_SIZE - pos % LOG_SIZE;
+
+		if (n > cnt)
+			n = cnt;
+		disk_read_many (filesys_disk, log_sector (pos), n, p);
+		p += n * DISK_SECTOR_SIZE;
+		pos += n;
+		cnt -= n;
+	}
+}
+
+/* Writes the journal header. */
+static void
+write_header (void) {
+	static struct journal_header h;
+
+	h.magic = JOURNAL_MAGIC;
+	h.tail = tail;
+	h.tail_seq = tail_seq;
+	disk_write (filesys_disk, JOURNAL_SECTOR, &h);
+}
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+ * one, otherwise replays whatever the log holds. */
+void
+journal_init (bool format) {
+	ASSERT (sizeof (struct journal_header) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct descriptor) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct commit_record) == DISK_SECTOR_SIZE);
+
+	lock_init (&journal_lock);
+	lock_init (&checkpoint_lock);
+	cond_init (&journal_cond);
+	hash_init (&tx_map, jentry_hash, jentry_less, NULL);
+	logged_map = bitmap_create (disk_size (filesys_disk));
+	ordered_map = bitmap_create (disk_size (filesys_disk));
+	if (logged_map == NULL || ordered_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
+	log_buf = calloc (LOG_BUF_SECTORS, DISK_SECTOR_SIZE);
+	if (log_buf == NULL)
+		PANIC ("journal init failed due to OOM");
+
+	if (format)
+		journal_format ();
+	else
+		journal_recover ();
+	thread_create ("journal", PRI_DEFAULT, committer, NULL);
+}
+
+/* Creates an empty journal.  The whole ring is zeroed, so that
+ * nothing left from an earlier file system can pass for a
+ * transaction.  LOG_BUF is still all zeros at this point. */
+static void
+journal_format (void) {
+	uint32_t pos;
+
+	for (pos = 0; pos < LOG_SIZE; pos += LOG_BUF_SECTORS)
+		log_write (pos, LOG_SIZE - pos < LOG_BUF_SECTORS
+				? LOG_SIZE - pos : LOG_BUF_SECTORS, log_buf);
+	head = tail = 0;
+	next_seq = tail_seq = 1;
+	write_header ();
+}
+
+/* Returns true if any of the N transactions in DESCS after number
+ * I revokes SECTOR. */
+static bool
+revoked_after (struct descriptor **descs, size_t n, size_t i,
+		disk_sector_t sector) {
+	size_t j, k;
+
+	for (j = i + 1; j < n; j++)
+		for (k = 0; k < descs[j]->cnt; k++)
+			if (descs[j]->sectors[k] == (sector | REVOKED))
+				return true;
+	return false;
+}
+
+/* Replays the committed transactions in the log, writing them
+ * straight to disk, and empties the log.  A transaction without
+ * its commit record, or with the wrong sequence number, ends the
+ * log. */
+static void
+journal_recover (void) {
+	static struct journal_header h;
+	static struct commit_record c;
+	struct descriptor **descs;
+	size_t n = 0, i, j, k, used = 0;
+	uint32_t pos, seq;
+
+	disk_read (filesys_disk, JOURNAL_SECTOR, &h);
+	if (h.magic != JOURNAL_MAGIC)
+		PANIC ("file system journal not found; reformat with -f");
+
+	/* Find the committed transactions. */
+	descs = malloc (LOG_SIZE / 2 * sizeof *descs);
+	if (descs == NULL)
+		PANIC ("journal recovery failed due to OOM");
+	pos = h.tail;
+	seq = h.tail_seq;
+	while (n < LOG_SIZE / 2) {
+		struct descriptor *d = malloc (sizeof *d);
+		size_t logged = 0;
+
+		if (d == NULL)
+			PANIC ("journal recovery failed due to OOM");
+		disk_read (filesys_disk, log_sector (pos), d);
+		if (d->magic != DESC_MAGIC || d->seq != seq || d->cnt > DESC_ENTRIES) {
+			free (d);
+			break;
+		}
+		for (k = 0; k < d->cnt; k++)
+			if (!(d->sectors[k] & REVOKED))
+				logged++;
+		used += logged + 2;
+		if (used >= LOG_SIZE) {
+			free (d);
+			break;
+		}
+		disk_read (filesys_disk, log_sector (pos + 1 + logged), &c);
+		if (c.magic != COMMIT_MAGIC || c.seq != seq) {
+			free (d);
+			break;
+		}
+		descs[n++] = d;
+		pos = (pos + logged + 2) % LOG_SIZE;
+		seq++;
+	}
+
+	/* Replay them in order, reading each transaction's contents
+	 * in one run.  A sector revoked by a later transaction holds
+	 * file data now, so it is skipped. */
+	pos = h.tail;
+	for (i = 0; i < n; i++) {
+		size_t logged = 0;
+
+		for (k = 0; k < descs[i]->cnt; k++)
+			if (!(descs[i]->sectors[k] & REVOKED))
+				logged++;
+		log_read (pos + 1, logged, log_buf);
+
+		j = 0;
+		for (k = 0; k < descs[i]->cnt; k++) {
+			disk_sector_t sector = descs[i]->sectors[k];
+
+			if (sector & REVOKED)
+				continue;
+			if (!revoked_after (descs, n, i, sector))
+				disk_write (filesys_disk, sector,
+						log_buf + j * DISK_SECTOR_SIZE);
+			j++;
+		}
+		pos = (pos + logged + 2) % LOG_SIZE;
+	}
+	for (i = 0; i < n; i++)
+		free (descs[i]);
+	free (descs);
+
+	head = tail = pos;
+	next_seq = tail_seq = seq;
+	write_header ();
+	if (n > 0)
+		printf ("journal: replayed %zu transactions\n", n);
+}
+
+/* Flushes the buffer cache, which puts every committed sector in
+ * its home location, and then empties the log.  Only the
+ * committing thread may call this, or a thread inside an
+ * operation holding checkpoint_lock: while an operation is
+ * active, no transaction can commit and move the log. */
+static void
+checkpoint (void) {
+	buffer_cache_flush ();
+	tail = head;
+	tail_seq = next_seq;
+	write_header ();
+
+	lock_acquire (&journal_lock);
+	bitmap_set_all (logged_map, false);
+	checkpoint_cnt++;
+	lock_release (&journal_lock);
+}
+
+/* Writes the running transaction to the log and hands its sectors
+ * to the buffer cache.  Only the committing thread may call this,
+ * with no operations active, so the transaction cannot change. */
+static void
+write_transaction (void) {
+	struct descriptor *desc = (struct descriptor *) log_buf;
+	static struct commit_record c;
+	static struct jentry *order[DESC_ENTRIES];
+	struct hash_iterator i;
+	size_t n = 0, k;
+	uint32_t pos;
+
+	/* Data sectors first: once the commit record is down, the
+	 * pointers to them may be replayed. */
+	if (ordered_cnt > 0) {
+		for (k = bitmap_scan (ordered_map, 0, 1, true); k != BITMAP_ERROR;
+				k = bitmap_scan (ordered_map, k + 1, 1, true))
+			buffer_cache_write_back (k);
+		bitmap_set_all (ordered_map, false);
+		ordered_cnt = 0;
+	}
+
+	if ((head + LOG_SIZE - tail) % LOG_SIZE + tx_logged + 2 >= LOG_SIZE)
+		checkpoint ();
+
+	desc->magic = DESC_MAGIC;
+	desc->seq = next_seq;
+	hash_first (&i, &tx_map);
+	while (hash_next (&i)) {
+		struct jentry *e = hash_entry (hash_cur (&i), struct jentry, elem);
+
+		ASSERT (e->image == NULL || e->valid);
+		order[n] = e;
+		desc->sectors[n++] = e->image != NULL ? e->sector : e->sector | REVOKED;
+	}
+	desc->cnt = n;
+
+	/* One sequential run: descriptor, contents, commit record.  The
+	 * descriptor and contents are gathered into LOG_BUF and go out
+	 * as one disk range.  disk_write_many() is synchronous, so the
+	 * commit record, written separately, lands last. */
+	pos = 1;
+	for (k = 0; k < n; k++)
+		if (order[k]->image != NULL)
+			memcpy (log_buf + pos++ * DISK_SECTOR_SIZE, order[k]->image,
+					DISK_SECTOR_SIZE);
+	log_write (head, pos, log_buf);
+	pos += head;
+	c.magic = COMMIT_MAGIC;
+	c.seq = next_seq;
+	disk_write (filesys_disk, log_sector (pos++), &c);
+	head = pos % LOG_SIZE;
+	next_seq++;
+
+	/* Committed.  The sectors may now go home whenever the buffer
+	 * cache likes. */
+	for (k = 0; k < n; k++)
+		if (order[k]->image != NULL) {
+			buffer_cache_write (order[k]->sector, order[k]->image,
+					0, DISK_SECTOR_SIZE);
+			bitmap_mark (logged_map, order[k]->sector);
+		}
+	commit_cnt++;
+	logged_cnt += tx_logged;
+}
+
+/* Commits the running transaction, once every operation in it has
+ * ended.  If another thread is already committing, just waits for
+ * it.  The caller must not be inside an operation of its own. */
+void
+journal_commit (void) {
+	lock_acquire (&journal_lock);
+	if (committing) {
+		while (committing)
+			cond_wait (&journal_cond, &journal_lock);
+		lock_release (&journal_lock);
+		return;
+	}
+	committing = true;
+	while (active_cnt > 0)
+		cond_wait (&journal_cond, &journal_lock);
+	lock_release (&journal_lock);
+
+	if (tx_cnt > 0)
+		write_transaction ();
+
+	lock_acquire (&journal_lock);
+	hash_clear (&tx_map, jentry_free);
+	tx_cnt = tx_logged = 0;
+	committing = false;
+	cond_broadcast (&journal_cond, &journal_lock);
+	lock_release (&journal_lock);
+}
+
+/* Commits the running transaction and checkpoints, leaving the
+ * log empty.  No other file system activity may remain. */
+void
+journal_done (void) {
+	journal_commit ();
+	checkpoint ();
+}
+
+/* Starts a file system operation that changes metadata.  Nested
+ * calls join the outer operation.  The outermost call may wait
+ * for a commit, so it must be made holding no file system lock. */
+void
+journal_begin (void) {
+	struct thread *t = thread_current ();
+
+	if (t->journal_depth++ > 0)
+		return;
+	ASSERT (t->fs_locks_held == 0);
+
+	lock_acquire (&journal_lock);
+	while (committing || tx_cnt >= TX_SOFT_MAX) {
+		if (!committing && active_cnt == 0) {
+			lock_release (&journal_lock);
+			journal_commit ();
+			lock_acquire (&journal_lock);
+			continue;
+		}
+		cond_wait (&journal_cond, &journal_lock);
+	}
+	active_cnt++;
+	op_cnt++;
+	lock_release (&journal_lock);
+}
+
+/* Ends the operation started by journal_begin().  The last
+ * operation to leave a full transaction commits it. */
+void
+journal_end (void) {
+	struct thread *t = thread_current ();
+	bool full;
+
+	ASSERT (t->journal_depth > 0);
+	if (--t->journal_depth > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	full = tx_cnt >= TX_SOFT_MAX;
+	if (--active_cnt == 0)
+		cond_broadcast (&journal_cond, &journal_lock);
+	lock_release (&journal_lock);
+
+	if (full)
+		journal_commit ();
+}
+
+/* Writes SIZE bytes from BUFFER into metadata sector SECTOR at
+ * byte OFS, as part of the running transaction. */
+void
+journal_write (disk_sector_t sector, const void *buffer, int ofs, int size) {
+	struct jentry *e;
+	bool logged, stale;
+
+	ASSERT (thread_current ()->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	e = tx_find (sector);
+	if (e == NULL)
+		e = tx_add (sector);
+	if (e != NULL && e->image == NULL) {
+		/* New, or reused for metadata after being revoked. */
+		e->image = malloc (DISK_SECTOR_SIZE);
+		e->valid = false;
+		if (e->image != NULL)
+			tx_logged++;
+	}
+	logged = e != NULL && e->image != NULL;
+	if (!logged)
+		overflow_cnt++;
+	stale = !logged && bitmap_test (logged_map, sector);
+	lock_release (&journal_lock);
+
+	if (stale) {
+		/* An older copy of SECTOR in the log would win at replay. */
+		lock_acquire (&checkpoint_lock);
+		checkpoint ();
+		lock_release (&checkpoint_lock);
+	}
+	if (logged)
+		buffer_cache_write_logged (sector, buffer, ofs, size);
+	else
+		buffer_cache_write (sector, buffer, ofs, size);
+}
+
+/* Notes that SECTOR, newly allocated, is about to hold file data,
+ * which is not journaled. */
+void
+journal_revoke (disk_sector_t sector) {
+	struct jentry *e;
+
+	ASSERT (thread_current ()->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	e = tx_find (sector);
+	if (e != NULL && e->image != NULL) {
+		free (e->image);
+		e->image = NULL;
+		tx_logged--;
+	} else if (e == NULL && bitmap_test (logged_map, sector))
+		tx_add (sector);
+	lock_release (&journal_lock);
+}
+
+/* Notes that data sector SECTOR, about to become readable through
+ * a pointer in the running transaction, must be written home
+ * before that transaction commits. */
+void
+journal_order (disk_sector_t sector) {
+	ASSERT (thread_current ()->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	if (!bitmap_test (ordered_map, sector)) {
+		bitmap_mark (ordered_map, sector);
+		ordered_cnt++;
+	}
+	lock_release (&journal_lock);
+}
+
+/* Called by the buffer cache with the new contents DATA of SECTOR,
+ * written by buffer_cache_write_logged(). */
+void
+journal_capture (disk_sector_t sector, const void *data) {
+	struct jentry *e;
+
+	lock_acquire (&journal_lock);
+	e = tx_find (sector);
+	if (e != NULL && e->image != NULL) {
+		memcpy (e->image, data, DISK_SECTOR_SIZE);
+		e->valid = true;
+	}
+	lock_release (&journal_lock);
+}
+
+/* Called by the buffer cache on a miss.  If SECTOR has uncommitted
+ * contents, copies them into DATA and returns true. */
+bool
+journal_read (disk_sector_t sector, void *data) {
+	struct jentry *e;
+	bool found;
+
+	lock_acquire (&journal_lock);
+	e = tx_find (sector);
+	found = e != NULL && e->image != NULL && e->valid;
+	if (found)
+		memcpy (data, e->image, DISK_SECTOR_SIZE);
+	lock_release (&journal_lock);
+	return found;
+}
+
+/* Committer thread: commits whatever has accumulated every
+ * COMMIT_INTERVAL, so that a crash loses little. */
+static void
+committer (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (COMMIT_INTERVAL);
+		journal_commit ();
+	}
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld commits of %lld operations, %lld sectors logged, "
+			"%lld checkpoints, %lld unlogged writes\n",
+			commit_cnt, op_cnt, logged_cnt, checkpoint_cnt, overflow_cnt);
+}
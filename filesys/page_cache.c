@@ -1,6 +1,78 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
+#include "filesys/page_cache.h"
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+
+/* Page cache.
+ *
+ * Caches whole pages of file data, keyed by inode and page
+ * number, so that read() and every mmap() of a file share one
+ * copy.  file_read_at() copies out of these pages.  A mapped file
+ * page is a VM_PAGE_CACHE page whose frame is the cache page
+ * itself, so ten processes mapping the same file use one frame
+ * per page between them.  The read-only pages of an executable
+ * are mapped the same way, so every process running a program
+ * shares its text.
+ *
+ * Writes go through to the inode first, and then each cached page
+ * they touch is patched if some process has it mapped, or simply
+ * dropped if not.  A page is filled with its lock held, and a
+ * writer that finds a page takes the same lock, so a fill that
+ * raced with the write cannot leave old data behind.  Directories
+ * and other metadata files are written below the file layer and
+ * are never cached here.
+ *
+ * Pages written through a mapping are found dirty when they are
+ * unmapped, and written back once, when the last mapping goes
+ * away.  A page nobody holds is therefore always clean, and may be
+ * reused for another page when the cache is full.  Mapped pages
+ * may push the cache past PAGE_CACHE_PAGES; reads past the limit
+ * with nothing to evict go straight to the inode.
+ *
+ * page_cache_lock protects the page table, the LRU list, and each
+ * page's ref_cnt and dirty flag.  A page's own lock protects its
+ * data, and is taken after page_cache_lock and before any file
+ * system lock. */
+
+#define PAGE_CACHE_PAGES 128            /* Pages cached when none is held. */
+
+/* A cached file page. */
+struct cache_page {
+	struct hash_elem elem;              /* Element in page_map. */
+	struct list_elem lru_elem;          /* Element in page_lru. */
+	struct inode *inode;                /* File. */
+	off_t index;                        /* Page number within the file. */
+	int ref_cnt;                        /* Mappings and copies in progress. */
+	bool dirty;                         /* Written through a mapping? */
+
+	struct lock lock;                   /* Protects the data. */
+	void *kva;                          /* PGSIZE bytes. */
+};
+
+static struct hash page_map;
+static struct list page_lru;            /* Most recently used first. */
+static struct lock page_cache_lock;
+static size_t page_cnt;
+
+/* Statistics. */
+static long long page_hit_cnt, page_miss_cnt;
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -13,38 +85,846 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
+static uint64_t
+cpage_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_page *cp = hash_entry (e, struct cache_page, elem);
+	return hash_bytes (&cp->inode, sizeof cp->inode) ^ hash_int (cp->index);
+}
+
+static bool
+cpage_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct cache_page *a = hash_entry (a_, struct cache_page, elem);
+	const struct cache_page *b = hash_entry (b_, struct cache_page, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->index < b->index;
+}
+
+/* Initializes the page cache. */
+void
+page_cache_init (void) {
+	hash_init (&page_map, cpage_hash, cpage_less, NULL);
+	list_init (&page_lru);
+	lock_init (&page_cache_lock);
+}
 
-/* The initializer of file vm */
+/* The VM side needs no setup of its own; page_cache_init() runs
+ * with the file system, because read() uses the cache with or
+ * without VM. */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
 }
 
-/* Initialize the page cache */
+/* Returns INODE's page INDEX if it is cached, or a null pointer.
+ * page_cache_lock must be held. */
+static struct cache_page *
+page_lookup (struct inode *inode, off_t index) {
+	struct cache_page key;
+	struct hash_elem *e;
+
+	key.inode = inode;
+	key.index = index;
+	e = hash_find (&page_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_page, elem) : NULL;
+}
+
+/* Removes CP, which nobody holds, from the cache and frees it.
+ * page_cache_lock must be held. */
+static void
+page_free (struct cache_page *cp) {
+	ASSERT (cp->ref_cnt == 0 && !cp->dirty);
+
+	hash_delete (&page_map, &cp->elem);
+	list_remove (&cp->lru_elem);
+	palloc_free_page (cp->kva);
+	free (cp);
+	page_cnt--;
+}
+
+/* Returns a page to hold new data: a fresh one if the cache is
+ * below its limit or FORCE is true, otherwise the least recently
+ * used page nobody holds, taken out of the cache.  Returns a null
+ * pointer if there is none.  page_cache_lock must be held. */
+static struct cache_page *
+page_alloc (bool force) {
+	struct cache_page *cp;
+	struct list_elem *e;
+
+	if (page_cnt >= PAGE_CACHE_PAGES)
+		for (e = list_rbegin (&page_lru); e != list_rend (&page_lru);
+				e = list_prev (e)) {
+			cp = list_entry (e, struct cache_page, lru_elem);
+			if (cp->ref_cnt == 0 && !cp->dirty) {
+				hash_delete (&page_map, &cp->elem);
+				list_remove (&cp->lru_elem);
+				return cp;
+			}
+		}
+	if (page_cnt >= PAGE_CACHE_PAGES && !force)
+		return NULL;
+
+	cp = malloc (sizeof *cp);
+	if (cp == NULL)
+		return NULL;
+	cp->kva = palloc_get_page (PAL_USER);
+	if (cp->kva == NULL) {
+		free (cp);
+		return NULL;
+	}
+	lock_init (&cp->lock);
+	page_cnt++;
+	return cp;
+}
+
+/* Returns INODE's page INDEX, held and filled, reading it in if
+ * it is not cached.  FORCE is as for page_alloc().  Returns a null
+ * pointer if no page is available.  Release the page with
+ * page_put(). */
+static struct cache_page *
+page_get (struct inode *inode, off_t index, bool force) {
+	struct cache_page *cp;
+	off_t got;
+
+	lock_acquire (&page_cache_lock);
+	cp = page_lookup (inode, index);
+	if (cp != NULL) {
+		cp->ref_cnt++;
+		list_remove (&cp->lru_elem);
+		list_push_front (&page_lru, &cp->lru_elem);
+		page_hit_cnt++;
+		lock_release (&page_cache_lock);
+
+		/* Waits for the fill, if the page is still loading. */
+		lock_acquire (&cp->lock);
+		lock_release (&cp->lock);
+		return cp;
+	}
+
+	cp = page_alloc (force);
+	if (cp == NULL) {
+		lock_release (&page_cache_lock);
+		return NULL;
+	}
+	cp->inode = inode;
+	cp->index = index;
+	cp->ref_cnt = 1;
+	cp->dirty = false;
+	hash_insert (&page_map, &cp->elem);
+	list_push_front (&page_lru, &cp->lru_elem);
+	page_miss_cnt++;
+
+	/* Take the page's lock before anyone else can find it. */
+	lock_acquire (&cp->lock);
+	lock_release (&page_cache_lock);
+
+	got = inode_read_at (inode, cp->kva, PGSIZE, index * PGSIZE);
+	memset ((uint8_t *) cp->kva + got, 0, PGSIZE - got);
+	lock_release (&cp->lock);
+	return cp;
+}
+
+/* Writes CP back to its file, up to the end of the file. */
+static void
+page_write_back (struct cache_page *cp) {
+	off_t ofs = cp->index * PGSIZE;
+	off_t size;
+
+	lock_acquire (&cp->lock);
+	size = inode_length (cp->inode) - ofs;
+	if (size > PGSIZE)
+		size = PGSIZE;
+	if (size > 0)
+		inode_write_at (cp->inode, cp->kva, size, ofs);
+	lock_release (&cp->lock);
+}
+
+/* Releases a page obtained from page_get().  The last holder of a
+ * dirty page writes it back first. */
+static void
+page_put (struct cache_page *cp) {
+	lock_acquire (&page_cache_lock);
+	while (cp->dirty && cp->ref_cnt == 1) {
+		cp->dirty = false;
+		lock_release (&page_cache_lock);
+		page_write_back (cp);
+		lock_acquire (&page_cache_lock);
+	}
+	cp->ref_cnt--;
+	lock_release (&page_cache_lock);
+}
+
+/* Reads SIZE bytes at OFFSET in INODE into BUFFER through the
+ * cache.  Returns the number of bytes read, which is short at end
+ * of file. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t length = inode_length (inode);
+	off_t done = 0;
+
+	if (offset >= length)
+		return 0;
+	if (size > length - offset)
+		size = length - offset;
+
+	while (done < size) {
+		off_t pos = offset + done;
+		off_t page_ofs = pos % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs < size - done
+			? PGSIZE - page_ofs : size - done;
+		struct cache_page *cp = page_get (inode, pos / PGSIZE, false);
+
+		if (cp == NULL) {
+			off_t got = inode_read_at (inode, buffer + done, chunk, pos);
+			done += got;
+			if (got < chunk)
+				break;
+			continue;
+		}
+		lock_acquire (&cp->lock);
+		memcpy (buffer + done, (uint8_t *) cp->kva + page_ofs, chunk);
+		lock_release (&cp->lock);
+		page_put (cp);
+		done += chunk;
+	}
+	return done;
+}
+
+/* Tells the cache that SIZE bytes from BUFFER were just written
+ * to INODE at OFFSET.  Mapped pages are patched to match; pages
+ * nobody holds are dropped and will be read in again. */
+void
+page_cache_wrote (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t index;
+
+	if (size <= 0)
+		return;
+	for (index = offset / PGSIZE; index <= (offset + size - 1) / PGSIZE;
+			index++) {
+		off_t start = index * PGSIZE > offset ? index * PGSIZE : offset;
+		off_t end = (index + 1) * PGSIZE < offset + size
+			? (index + 1) * PGSIZE : offset + size;
+		struct cache_page *cp;
+
+		lock_acquire (&page_cache_lock);
+		cp = page_lookup (inode, index);
+		if (cp == NULL || cp->ref_cnt == 0) {
+			if (cp != NULL)
+				page_free (cp);
+			lock_release (&page_cache_lock);
+			continue;
+		}
+		cp->ref_cnt++;
+		lock_release (&page_cache_lock);
+
+		lock_acquire (&cp->lock);
+		memcpy ((uint8_t *) cp->kva + (start - index * PGSIZE),
+				buffer + (start - offset), end - start);
+		lock_release (&cp->lock);
+		page_put (cp);
+	}
+}
+
+/* Drops every cached page of INODE, which is going away.  No page
+ * of it may be held. */
+void
+page_cache_forget (struct inode *inode) {
+	struct list_elem *e;
+
+	lock_acquire (&page_cache_lock);
+	for (e = list_begin (&page_lru); e != list_end (&page_lru); ) {
+		struct cache_page *cp = list_entry (e, struct cache_page, lru_elem);
+
+		e = list_next (e);
+		if (cp->inode == inode)
+			page_free (cp);
+	}
+	lock_release (&page_cache_lock);
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Page cache: %lld hits, %lld misses, %zu pages\n",
+			page_hit_cnt, page_miss_cnt, page_cnt);
+}
+
+/* Returns the mapping data of PAGE, a VM_PAGE_CACHE page, whether
+ * or not it has been faulted in yet. */
+struct page_cache *
+page_cache_of (struct page *page) {
+	ASSERT (VM_TYPE (page_get_type (page)) == VM_PAGE_CACHE);
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		? page->uninit.aux : &page->page_cache;
+}
+
+/* Returns mapping data for page OFS of INODE in the mmap() region
+ * starting at MAP_ADDR, to pass as the aux of a new VM_PAGE_CACHE
+ * page.  Takes its own reference to INODE.  Returns a null pointer
+ * if memory is short. */
+struct page_cache *
+page_cache_map_info (struct inode *inode, off_t ofs, void *map_addr) {
+	struct page_cache *pc = malloc (sizeof *pc);
+
+	if (pc != NULL) {
+		pc->inode = inode_reopen (inode);
+		pc->ofs = ofs;
+		pc->map_addr = map_addr;
+		pc->cp = NULL;
+	}
+	return pc;
+}
+
+/* Gives up mapping data PC: releases its cache page, writing it
+ * back if DIRTY and no one else has it mapped, and closes its
+ * inode.  Does not free PC. */
+void
+page_cache_unmap (struct page_cache *pc, bool dirty) {
+	if (pc->cp != NULL) {
+		if (dirty) {
+			lock_acquire (&page_cache_lock);
+			pc->cp->dirty = true;
+			lock_release (&page_cache_lock);
+		}
+		page_put (pc->cp);
+		pc->cp = NULL;
+	}
+	inode_close (pc->inode);
+	pc->inode = NULL;
+}
+
+/* Returns a frame for PAGE, a VM_PAGE_CACHE page about to be
+ * mapped, whose kva is the cache page itself.  Returns a null
+ * pointer if memory is short. */
+struct frame *
+page_cache_get_frame (struct page *page) {
+	struct page_cache *pc = page_cache_of (page);
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame == NULL)
+		return NULL;
+	if (pc->cp == NULL)
+		pc->cp = page_get (pc->inode, pc->ofs / PGSIZE, true);
+	if (pc->cp == NULL) {
+		free (frame);
+		return NULL;
+	}
+	frame->kva = pc->cp->kva;
+	frame->page = page;
+	return frame;
+}
+
+/* Initializes a VM_PAGE_CACHE page on its first fault.  The data
+ * is already in the frame that page_cache_get_frame() found. */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
-	/* Set up the handler */
-	page->operations = &page_cache_op;
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	struct page_cache *pc = page->uninit.aux;
 
+	page->operations = &page_cache_op;
+	page->page_cache = *pc;
+	free (pc);
+	return true;
 }
 
-/* Utilze the Swap in mechanism to implement readhead */
+/* The cache page stays in memory while mapped, so there is
+ * nothing to read back in. */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page, void *kva UNUSED) {
+	return page->page_cache.cp != NULL;
 }
 
-/* Utilze the Swap out mechanism to implement writeback */
+/* Unmaps PAGE from the running process, noting whether it was
+ * written through the mapping. */
 static bool
 page_cache_writeback (struct page *page) {
+	struct thread *t = thread_current ();
+	bool dirty = false;
+
+	if (page->frame != NULL) {
+		dirty = pml4_is_dirty (t->pml4, page->va);
+		pml4_clear_page (t->pml4, page->va);
+		free (page->frame);
+		page->frame = NULL;
+	}
+	/* A read-only page, such as shared executable text, is never
+	 * written back, whatever its dirty bit says. */
+	if (dirty && page->writable && page->page_cache.cp != NULL) {
+		lock_acquire (&page_cache_lock);
+		page->page_cache.cp->dirty = true;
+		lock_release (&page_cache_lock);
+	}
+	return true;
 }
 
-/* Destory the page_cache. */
+/* Destroys a VM_PAGE_CACHE page: unmaps it and releases its cache
+ * page.  PAGE will be freed by the caller. */
 static void
 page_cache_destroy (struct page *page) {
+	page_cache_writeback (page);
+	page_cache_unmap (&page->page_cache, false);
+}
+
+/* Buffer cache.
+ *
+ * Caches CACHE_SIZE sectors of the file system disk.  A sector is
+ * found through a hash table keyed by sector number, and slots
+ * are replaced with the clock algorithm.  Writes only mark a slot
+ * dirty.  Dirty slots reach the disk when they are evicted, when
+ * the flusher thread finds them dirty for longer than
+ * DIRTY_EXPIRE, and when the file system shuts down.  Flushing
+ * writes cached runs of consecutive dirty sectors with one disk
+ * command each.
+ *
+ * Readahead is asynchronous: buffer_cache_prefetch() only queues
+ * a sector, and the prefetcher thread reads it in later.
+ *
+ * cache_lock protects the hash table, the clock hand, and each
+ * slot's sector, in_use, accessed and pin_cnt.  A slot's own
+ * lock protects its data and dirty state, and is held across
+ * the disk read that fills it.  A slot with a nonzero pin_cnt is
+ * in use by some thread and is never evicted.  Lock order is
+ * cache_lock, then a slot's lock, then the journal's lock.  A
+ * thread holding a slot's lock may still take cache_lock briefly:
+ * only unpinned slots are locked under cache_lock, and no one
+ * holds an unpinned slot's lock.
+ *
+ * A sector written with buffer_cache_write_logged() belongs to a
+ * journal transaction that has not committed yet.  Its slot is
+ * left clean, so it cannot reach the disk early, and if it is
+ * evicted the journal supplies its contents on the next miss. */
+
+#define CACHE_SIZE 64                   /* Number of cached sectors. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ) /* Ticks between flusher runs. */
+#define DIRTY_EXPIRE (30 * TIMER_FREQ)  /* Ticks a slot may stay dirty. */
+#define PREFETCH_MAX 64                 /* Prefetch queue capacity. */
+#define FLUSH_RUN_MAX 16                /* Sectors per write-back run. */
+
+/* A cached sector. */
+struct cache_slot {
+	struct hash_elem elem;              /* Element in cache_map. */
+	disk_sector_t sector;               /* Sector held, if in_use. */
+	bool in_use;                        /* Holds a sector? */
+	bool accessed;                      /* Used since the hand passed? */
+	int pin_cnt;                        /* Threads using this slot. */
+
+	struct lock lock;                   /* Protects the members below. */
+	bool dirty;                         /* Newer than the disk? */
+	int64_t dirty_since;                /* Tick at which it became dirty. */
+	uint8_t *data;                      /* DISK_SECTOR_SIZE bytes. */
+};
+
+static struct cache_slot slots[CACHE_SIZE];
+static struct hash cache_map;
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when pin_cnt drops to 0. */
+static size_t clock_hand;
+
+/* Sectors waiting to be prefetched, a ring protected by
+ * cache_lock. */
+static disk_sector_t prefetch_queue[PREFETCH_MAX];
+static size_t prefetch_head, prefetch_cnt;
+static struct condition prefetch_ready; /* Signaled when queue non-empty. */
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, writeback_cnt, prefetch_total;
+
+static void flusher (void *);
+static void prefetcher (void *);
+
+static uint64_t
+slot_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct cache_slot, elem)->sector);
+}
+
+static bool
+slot_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_slot, elem)->sector
+		< hash_entry (b, struct cache_slot, elem)->sector;
+}
+
+/* Initializes the buffer cache and starts its flusher thread. */
+void
+buffer_cache_init (void) {
+	uint8_t *data;
+	size_t i;
+
+	data = palloc_get_multiple (PAL_ASSERT,
+			CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		lock_init (&slots[i].lock);
+		slots[i].data = data + i * DISK_SECTOR_SIZE;
+	}
+	hash_init (&cache_map, slot_hash, slot_less, NULL);
+	lock_init (&cache_lock);
+	cond_init (&cache_unpinned);
+	cond_init (&prefetch_ready);
+
+	thread_create ("bcache-flush", PRI_DEFAULT, flusher, NULL);
+	thread_create ("bcache-ra", PRI_DEFAULT, prefetcher, NULL);
+}
+
+/* Returns the slot holding SECTOR, or a null pointer if SECTOR is
+ * not cached.  cache_lock must be held. */
+static struct cache_slot *
+slot_lookup (disk_sector_t sector) {
+	struct cache_slot key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_slot, elem) : NULL;
+}
+
+/* Writes S back to disk.  The caller must own S's data. */
+static void
+slot_write_back (struct cache_slot *s) {
+	disk_write (filesys_disk, s->sector, s->data);
+	s->dirty = false;
+	writeback_cnt++;
+}
+
+/* Picks a slot to reuse, writing it back if needed, and removes
+ * it from the cache.  Waits if every slot is pinned.
+ * cache_lock must be held.  It is dropped while a dirty victim is
+ * written back, so that the disk write does not hold up every
+ * other cache access. */
+static struct cache_slot *
+slot_evict (void) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		size_t i;
+
+		for (i = 0; i < 2 * CACHE_SIZE; i++) {
+			struct cache_slot *s = &slots[clock_hand];
+			clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+			if (s->pin_cnt > 0)
+				continue;
+			if (s->accessed) {
+				s->accessed = false;
+				continue;
+			}
+			if (s->in_use && s->dirty) {
+				/* Pinned, it stays put while cache_lock is out. */
+				s->pin_cnt++;
+				lock_release (&cache_lock);
+
+				lock_acquire (&s->lock);
+				if (s->dirty)
+					slot_write_back (s);
+				lock_release (&s->lock);
+
+				lock_acquire (&cache_lock);
+				s->pin_cnt--;
+
+				/* Someone may have found it or written it
+				 * meanwhile.  If so, keep looking. */
+				if (s->pin_cnt > 0 || s->dirty) {
+					if (s->pin_cnt == 0)
+						cond_signal (&cache_unpinned, &cache_lock);
+					continue;
+				}
+			}
+			if (s->in_use) {
+				/* Unpinned and clean, so no one else can be using
+				 * its data. */
+				hash_delete (&cache_map, &s->elem);
+				s->in_use = false;
+			}
+			return s;
+		}
+		cond_wait (&cache_unpinned, &cache_lock);
+	}
+}
+
+/* Returns the slot holding SECTOR, pinned and with its lock held,
+ * loading the sector into a free slot if necessary.  If FILL is
+ * false the caller is about to overwrite the whole sector, so a
+ * miss does not read it from disk. */
+static struct cache_slot *
+slot_get (disk_sector_t sector, bool fill) {
+	struct cache_slot *s, *victim = NULL;
+
+	lock_acquire (&cache_lock);
+	for (;;) {
+		s = slot_lookup (sector);
+		if (s != NULL) {
+			/* A victim evicted for nothing just stays free. */
+			s->pin_cnt++;
+			s->accessed = true;
+			hit_cnt++;
+			lock_release (&cache_lock);
+
+			/* Waits for the disk read, if the sector is still loading. */
+			lock_acquire (&s->lock);
+			return s;
+		}
+		if (victim != NULL)
+			break;
+
+		/* slot_evict() may drop cache_lock, letting someone else
+		 * load SECTOR meanwhile, so look again. */
+		victim = slot_evict ();
+	}
+
+	s = victim;
+	s->sector = sector;
+	s->in_use = true;
+	s->accessed = true;
+	s->pin_cnt = 1;
+	hash_insert (&cache_map, &s->elem);
+	miss_cnt++;
+
+	/* Take the slot's lock before anyone else can find it. */
+	lock_acquire (&s->lock);
+	lock_release (&cache_lock);
+
+	if (fill && !journal_read (sector, s->data))
+		disk_read (filesys_disk, sector, s->data);
+	return s;
+}
+
+/* Drops one pin on S. */
+static void
+slot_unpin (struct cache_slot *s) {
+	lock_acquire (&cache_lock);
+	if (--s->pin_cnt == 0)
+		cond_signal (&cache_unpinned, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Releases a slot obtained from slot_get(). */
+static void
+slot_put (struct cache_slot *s) {
+	lock_release (&s->lock);
+	slot_unpin (s);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_slot *s;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	s = slot_get (sector, true);
+	memcpy (buffer, s->data + ofs, size);
+	slot_put (s);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+ * The data reaches the disk later. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer,
+		int ofs, int size) {
+	struct cache_slot *s;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	s = slot_get (sector, ofs > 0 || size < DISK_SECTOR_SIZE);
+	memcpy (s->data + ofs, buffer, size);
+	if (!s->dirty) {
+		s->dirty = true;
+		s->dirty_since = timer_ticks ();
+	}
+	slot_put (s);
+}
+
+/* Like buffer_cache_write(), for a sector in the running journal
+ * transaction.  The slot is left clean: the journal takes a copy
+ * of the whole sector and hands it back once the transaction
+ * commits.  A dirty slot is written back first, since it may hold
+ * a committed image that a checkpoint would otherwise drop from
+ * the log before it reached its home location. */
+void
+buffer_cache_write_logged (disk_sector_t sector, const void *buffer,
+		int ofs, int size) {
+	struct cache_slot *s;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	s = slot_get (sector, ofs > 0 || size < DISK_SECTOR_SIZE);
+	if (s->dirty)
+		slot_write_back (s);
+	memcpy (s->data + ofs, buffer, size);
+	journal_capture (sector, s->data);
+	slot_put (s);
+}
+
+/* Writes SECTOR to disk now if it is cached and dirty. */
+void
+buffer_cache_write_back (disk_sector_t sector) {
+	struct cache_slot *s;
+
+	lock_acquire (&cache_lock);
+	s = slot_lookup (sector);
+	if (s == NULL) {
+		lock_release (&cache_lock);
+		return;
+	}
+	s->pin_cnt++;
+	lock_release (&cache_lock);
+
+	lock_acquire (&s->lock);
+	if (s->dirty)
+		slot_write_back (s);
+	slot_put (s);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+ * The request is dropped if SECTOR is already cached or the
+ * queue is full. */
+void
+buffer_cache_prefetch (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (slot_lookup (sector) == NULL && prefetch_cnt < PREFETCH_MAX) {
+		prefetch_queue[(prefetch_head + prefetch_cnt++) % PREFETCH_MAX] = sector;
+		cond_signal (&prefetch_ready, &cache_lock);
+	}
+	lock_release (&cache_lock);
 }
 
-/* Worker thread for page cache */
+/* Prefetcher thread: reads in the sectors queued by
+ * buffer_cache_prefetch(). */
 static void
-page_cache_kworkerd (void *aux) {
+prefetcher (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+
+		lock_acquire (&cache_lock);
+		while (prefetch_cnt == 0)
+			cond_wait (&prefetch_ready, &cache_lock);
+		sector = prefetch_queue[prefetch_head];
+		prefetch_head = (prefetch_head + 1) % PREFETCH_MAX;
+		prefetch_cnt--;
+		prefetch_total++;
+		lock_release (&cache_lock);
+
+		slot_put (slot_get (sector, true));
+	}
+}
+
+/* Collects into RUN the slots that follow RUN[0], which the
+ * caller owns, for as long as they hold the next sectors, are
+ * dirty since tick DIRTY_BEFORE or earlier, and can be locked
+ * without waiting.  Returns the length of the run, at most
+ * FLUSH_RUN_MAX, with every slot after the first pinned and
+ * locked. */
+static size_t
+gather_run (struct cache_slot *run[], int64_t dirty_before) {
+	size_t n;
+
+	for (n = 1; n < FLUSH_RUN_MAX; n++) {
+		struct cache_slot *s;
+
+		lock_acquire (&cache_lock);
+		s = slot_lookup (run[0]->sector + n);
+		if (s != NULL)
+			s->pin_cnt++;
+		lock_release (&cache_lock);
+		if (s == NULL)
+			break;
+
+		/* Trying, rather than waiting, keeps slot locks from being
+		 * taken out of order. */
+		if (!lock_try_acquire (&s->lock)) {
+			slot_unpin (s);
+			break;
+		}
+		if (!s->dirty || s->dirty_since > dirty_before) {
+			slot_put (s);
+			break;
+		}
+		run[n] = s;
+	}
+	return n;
+}
+
+/* Writes back the N slots in RUN, which hold consecutive sectors,
+ * with a single disk command staged through BUF.  Releases all but
+ * RUN[0]. */
+static void
+write_back_run (struct cache_slot *run[], size_t n, uint8_t *buf) {
+	size_t k;
+
+	for (k = 0; k < n; k++)
+		memcpy (buf + k * DISK_SECTOR_SIZE, run[k]->data, DISK_SECTOR_SIZE);
+	disk_write_many (filesys_disk, run[0]->sector, n, buf);
+	for (k = 0; k < n; k++) {
+		run[k]->dirty = false;
+		writeback_cnt++;
+		if (k > 0)
+			slot_put (run[k]);
+	}
+}
+
+/* Writes back every slot that has been dirty since tick
+ * DIRTY_BEFORE or earlier. */
+static void
+flush_dirty (int64_t dirty_before) {
+	struct cache_slot *run[FLUSH_RUN_MAX];
+	uint8_t *buf;
+	size_t i;
+
+	/* Without a staging buffer, sectors go one at a time. */
+	buf = palloc_get_multiple (0, FLUSH_RUN_MAX * DISK_SECTOR_SIZE / PGSIZE);
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_slot *s = &slots[i];
+
+		lock_acquire (&cache_lock);
+		if (!s->in_use) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		s->pin_cnt++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&s->lock);
+		if (s->dirty && s->dirty_since <= dirty_before) {
+			size_t n = 1;
+
+			run[0] = s;
+			if (buf != NULL)
+				n = gather_run (run, dirty_before);
+			if (n > 1)
+				write_back_run (run, n, buf);
+			else
+				slot_write_back (s);
+		}
+		slot_put (s);
+	}
+	palloc_free_multiple (buf, FLUSH_RUN_MAX * DISK_SECTOR_SIZE / PGSIZE);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+buffer_cache_flush (void) {
+	flush_dirty (INT64_MAX);
+}
+
+/* Flusher thread: periodically writes back sectors that have
+ * been dirty for a while, so that a crash loses little. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		flush_dirty (timer_ticks () - DIRTY_EXPIRE);
+	}
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	printf ("Buffer cache: %lld hits, %lld misses, %lld write-backs, "
+			"%lld prefetches\n",
+			hit_cnt, miss_cnt, writeback_cnt, prefetch_total);
 }
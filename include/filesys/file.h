@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -11,6 +12,10 @@ struct file;
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
 struct file *file_duplicate (struct file *file);
+bool file_pipe (struct file *ends[2]);
+bool file_is_pipe (struct file *);
+bool file_can_read (struct file *);
+bool file_can_write (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
 
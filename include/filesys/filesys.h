@@ -4,13 +4,40 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
-/* Sectors of system file inodes. */
+/* Sectors of system file inodes.  With EFILESYS there is no free
+ * map file, and the root directory is the first data cluster. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#define ROOT_DIR_SECTOR cluster_to_sector (ROOT_DIR_CLUSTER)
+#else
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#endif
+
+/* Metadata journal: a header sector followed by the log. */
+#define JOURNAL_SECTOR 2        /* First sector of the journal. */
+#define JOURNAL_SECTORS 256     /* Sectors in the journal. */
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
+struct lock;
+
+/* File system locks, in the order they must be acquired.  A thread
+ * may acquire one only while holding no lock of the same or a later
+ * rank, which fs_lock_acquire() asserts.  The buffer cache's own
+ * locks come after all of these. */
+enum fs_lock_rank {
+	FS_LOCK_DIR,            /* A directory's entries. */
+	FS_LOCK_INODE,          /* An inode's block index and length. */
+	FS_LOCK_ALLOC,          /* The free map or the FAT. */
+	FS_LOCK_DCACHE,         /* The directory-entry cache. */
+	FS_LOCK_INODE_TABLE,    /* The table of in-memory inodes. */
+};
+
+void fs_lock_acquire (struct lock *, enum fs_lock_rank);
+void fs_lock_release (struct lock *, enum fs_lock_rank);
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
@@ -5,6 +5,14 @@
 #include <stddef.h>
 #include "devices/disk.h"
 
+/* Sectors set aside for one growing file, so that its data stays
+ * contiguous even while other files grow.  START is the next
+ * sector to hand out, or where to look for more once CNT is 0. */
+struct free_map_rsv {
+	disk_sector_t start;
+	size_t cnt;
+};
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -12,6 +20,11 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate_near (disk_sector_t goal, disk_sector_t *);
 void free_map_release (disk_sector_t, size_t);
 
+void free_map_rsv_init (struct free_map_rsv *, disk_sector_t goal);
+bool free_map_allocate_rsv (struct free_map_rsv *, disk_sector_t *);
+void free_map_rsv_release (struct free_map_rsv *);
+
 #endif /* filesys/free-map.h */
@@ -0,0 +1,23 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_print_stats (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+
+void journal_write (disk_sector_t, const void *buffer, int ofs, int size);
+void journal_revoke (disk_sector_t);
+void journal_order (disk_sector_t);
+
+/* For the buffer cache. */
+void journal_capture (disk_sector_t, const void *data);
+bool journal_read (disk_sector_t, void *data);
+
+#endif /* filesys/journal.h */
@@ -1,12 +1,50 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 
 struct page;
+struct frame;
+struct inode;
+struct cache_page;
 enum vm_type;
 
-struct page_cache {};
+/* A VM_PAGE_CACHE page: one page of an mmap() region, mapped to
+ * the page cache's copy of the file page. */
+struct page_cache {
+	struct inode *inode;        /* Mapped file, opened for this page. */
+	off_t ofs;                  /* Page-aligned offset in the file. */
+	void *map_addr;             /* Start of the mmap() region, or
+	                               null for executable text. */
+	struct cache_page *cp;      /* Cache page, once faulted in. */
+};
 
+/* Page cache of file data. */
 void page_cache_init (void);
+off_t page_cache_read (struct inode *, void *, off_t size, off_t offset);
+void page_cache_wrote (struct inode *, const void *, off_t size,
+		off_t offset);
+void page_cache_forget (struct inode *);
+void page_cache_print_stats (void);
+
+/* File pages mapped into user memory. */
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+struct page_cache *page_cache_of (struct page *);
+struct page_cache *page_cache_map_info (struct inode *, off_t ofs,
+		void *map_addr);
+void page_cache_unmap (struct page_cache *, bool dirty);
+struct frame *page_cache_get_frame (struct page *);
+
+/* Buffer cache for the file system disk. */
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t, void *buffer, int ofs, int size);
+void buffer_cache_write (disk_sector_t, const void *buffer, int ofs, int size);
+void buffer_cache_write_logged (disk_sector_t, const void *buffer,
+		int ofs, int size);
+void buffer_cache_write_back (disk_sector_t);
+void buffer_cache_prefetch (disk_sector_t);
+void buffer_cache_flush (void);
+void buffer_cache_print_stats (void);
 #endif
@@ -36,6 +36,16 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_PREAD,                  /* Read from a file at an offset. */
+	SYS_PWRITE,                 /* Write to a file at an offset. */
+	SYS_READV,                  /* Read into several buffers. */
+	SYS_WRITEV,                 /* Write from several buffers. */
+	SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+	SYS_SENDFILE,               /* Copy a file to a file or the console. */
+	SYS_AIO_SETUP,              /* Map an asynchronous I/O ring. */
+	SYS_AIO_ENTER,              /* Submit to and wait on the ring. */
+	SYS_PIPE,                   /* Create a pipe. */
 };
 
 #endif /* lib/syscall-nr.h */
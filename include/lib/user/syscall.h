@@ -13,6 +13,51 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
 
+/* One buffer of a readv() or writev() call. */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+/* Maximum number of buffers in a readv() or writev() call. */
+#define IOV_MAX 64
+
+/* Asynchronous I/O ring, set up with aio_setup().  Fill
+   sq[sq_tail % AIO_ENTRIES] and advance sq_tail to queue an
+   operation; aio_enter() submits queued operations and posts their
+   results at cq[cq_tail % AIO_ENTRIES].  Advance cq_head past each
+   completion once it has been consumed. */
+#define AIO_ENTRIES 64
+
+enum aio_op {
+	AIO_READ,                   /* Read LEN bytes at OFFSET into BUF. */
+	AIO_WRITE,                  /* Write LEN bytes from BUF at OFFSET. */
+	AIO_FSYNC,                  /* Make everything written so far durable. */
+	AIO_OPEN,                   /* Open the file named by BUF. */
+};
+
+struct aio_sqe {
+	int opcode;                 /* An enum aio_op. */
+	int fd;                     /* File, except for AIO_OPEN. */
+	void *buf;                  /* Buffer, or file name. */
+	unsigned len;               /* Bytes to transfer, at most a page. */
+	off_t offset;               /* File offset. */
+	unsigned long long user_data;
+};
+
+struct aio_cqe {
+	unsigned long long user_data;
+	int res;                    /* Bytes, new fd, 0, or -1 on error. */
+	int pad;
+};
+
+struct aio_ring {
+	volatile unsigned sq_head, sq_tail;
+	volatile unsigned cq_head, cq_tail;
+	struct aio_sqe sq[AIO_ENTRIES];
+	struct aio_cqe cq[AIO_ENTRIES];
+};
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -35,6 +80,15 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+int sendfile (int out_fd, int in_fd, unsigned length);
+struct aio_ring *aio_setup (void *addr);
+int aio_enter (unsigned to_submit, unsigned min_complete);
+int pipe (int fds[2]);
 
 int dup2(int oldfd, int newfd);
 
@@ -0,0 +1,17 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Size and required alignment of an FXSAVE area. */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+void fpu_init (void);
+void fpu_switch (struct thread *next);
+bool fpu_copy (struct thread *dst, struct thread *src);
+void fpu_discard (struct thread *);
+
+#endif /* threads/fpu.h */
@@ -120,6 +120,10 @@ struct thread {
 	bool is_user;
 
 	struct file *exec_file;
+	struct dir *cwd;                    /* Working directory, or null. */
+	unsigned fs_locks_held;             /* Ranks of file system locks held. */
+	int journal_depth;                  /* Nesting of journal_begin(). */
+	struct aio_ctx *aio;                /* Asynchronous I/O ring, or null. */
 
 	struct semaphore wait_sema;
 	struct semaphore fork_sema;
@@ -140,6 +144,7 @@ struct thread {
 
 	/* Owned by thread.c. */
 	struct intr_frame tf;               /* Information for switching */
+	void *fpu_area;                     /* FXSAVE area (threads/fpu.c). */
 	unsigned magic;                     /* Detects stack overflow. */
 };
 
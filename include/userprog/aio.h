@@ -0,0 +1,55 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* Asynchronous I/O rings.  These layouts are shared with user
+   programs and must match lib/user/syscall.h. */
+
+/* Entries in each ring.  Must be a power of 2. */
+#define AIO_ENTRIES 64
+
+/* Operations. */
+enum aio_op {
+	AIO_READ,                   /* Read LEN bytes at OFFSET into BUF. */
+	AIO_WRITE,                  /* Write LEN bytes from BUF at OFFSET. */
+	AIO_FSYNC,                  /* Make everything written so far durable. */
+	AIO_OPEN,                   /* Open the file named by BUF. */
+};
+
+/* Submission queue entry. */
+struct aio_sqe {
+	int opcode;                 /* An enum aio_op. */
+	int fd;                     /* File, except for AIO_OPEN. */
+	void *buf;                  /* User buffer, or file name. */
+	unsigned len;               /* Bytes to transfer, at most PGSIZE. */
+	off_t offset;               /* File offset. */
+	uint64_t user_data;         /* Returned in the completion. */
+};
+
+/* Completion queue entry. */
+struct aio_cqe {
+	uint64_t user_data;         /* From the submission. */
+	int res;                    /* Bytes, new fd, 0, or -1 on error. */
+	int pad;
+};
+
+/* The page shared between a process and the kernel.  The process
+   fills SQ entries and advances SQ_TAIL; the kernel consumes them
+   and advances SQ_HEAD.  The kernel fills CQ entries and advances
+   CQ_TAIL; the process consumes them and advances CQ_HEAD.
+   Indexes run freely and are reduced modulo AIO_ENTRIES. */
+struct aio_ring {
+	unsigned sq_head, sq_tail;
+	unsigned cq_head, cq_tail;
+	struct aio_sqe sq[AIO_ENTRIES];
+	struct aio_cqe cq[AIO_ENTRIES];
+};
+
+void aio_init (void);
+void *aio_setup (void *addr);
+int aio_enter (unsigned to_submit, unsigned min_complete);
+void aio_destroy (void);
+
+#endif /* userprog/aio.h */
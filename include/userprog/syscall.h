@@ -1,6 +1,12 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
+struct file;
+
 void syscall_init (void);
+bool is_valid_fd (int fd);
+int fd_install (struct file *);
 
 #endif /* userprog/syscall.h */
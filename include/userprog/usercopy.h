@@ -0,0 +1,14 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+bool copyin (void *dst, const void *usrc, size_t size);
+bool copyout (void *udst, const void *src, size_t size);
+bool probe_user (const void *uaddr, size_t size, bool write);
+int64_t strncpy_from_user (char *dst, const char *usrc, size_t size);
+uintptr_t usercopy_fixup (uintptr_t rip);
+
+#endif /* userprog/usercopy.h */
@@ -30,9 +30,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
-#ifdef EFILESYS
 #include "filesys/page_cache.h"
-#endif
 
 struct page_operations;
 struct thread;
@@ -58,9 +56,7 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
-#ifdef EFILESYS
 		struct page_cache page_cache;
-#endif
 	};
 };
 
@@ -326,6 +326,27 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, which must already hold the rest of B.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+		size_t start, size_t cnt) {
+	off_t ofs, end;
+
+	ASSERT (start <= b->bit_cnt);
+	ASSERT (cnt <= b->bit_cnt - start);
+	if (cnt == 0)
+		return true;
+
+	ofs = elem_idx (start) * sizeof (elem_type);
+	end = (elem_idx (start + cnt - 1) + 1) * sizeof (elem_type);
+	if (end > (off_t) byte_cnt (b->bit_cnt))
+		end = byte_cnt (b->bit_cnt);
+	return file_write_at (file, (const uint8_t *) b->bits + ofs,
+			end - ofs, ofs) == end - ofs;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
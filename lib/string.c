@@ -1,5 +1,28 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The block routines below move a machine word at a time once
+   the destination is word-aligned, and switch to the string
+   instructions (`rep movsq', `rep stosq') for blocks of at least
+   REP_THRESHOLD bytes, such as whole pages and disk sectors.
+   x86-64 allows unaligned loads, so only the destination needs
+   to be aligned.  The string instructions rely on the direction
+   flag being clear, as the ABI requires. */
+
+/* Blocks at least this long use the string instructions. */
+#define REP_THRESHOLD 256
+
+/* A machine word that may alias any other type. */
+typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+#define WORD_SIZE sizeof (word_t)
+
+/* Returns true if P is aligned on a word boundary. */
+static inline bool
+word_aligned (const void *p) {
+	return ((uintptr_t) p & (WORD_SIZE - 1)) == 0;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,6 +34,21 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
+	/* Align the destination, then move whole words. */
+	for (; size > 0 && !word_aligned (dst); size--)
+		*dst++ = *src++;
+	if (size >= REP_THRESHOLD) {
+		size_t cnt = size / WORD_SIZE;
+		asm volatile ("rep movsq"
+				: "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+		size %= WORD_SIZE;
+	} else {
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			*(word_t *) dst = *(const word_t *) src;
+			dst += WORD_SIZE;
+			src += WORD_SIZE;
+		}
+	}
 	while (size-- > 0)
 		*dst++ = *src++;
 
@@ -27,17 +65,26 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
+	/* A forward copy reads each word before it can be
+	   overwritten whenever DST is below SRC. */
+	if (dst < src || dst >= src + size)
+		return memcpy (dst_, src_, size);
+
+	/* Copy backward, a word at a time once the end of the
+	   destination is aligned. */
+	dst += size;
+	src += size;
+	for (; size > 0 && !word_aligned (dst); size--)
+		*--dst = *--src;
+	for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+		dst -= WORD_SIZE;
+		src -= WORD_SIZE;
+		*(word_t *) dst = *(const word_t *) src;
 	}
+	while (size-- > 0)
+		*--dst = *--src;
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +99,14 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip over equal words; the bytes of the first unequal word
+	   are compared one at a time below. */
+	for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+		if (*(const word_t *) a != *(const word_t *) b)
+			break;
+		a += WORD_SIZE;
+		b += WORD_SIZE;
+	}
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -256,23 +311,50 @@ strtok_r (char *s, const char *delimiters, char **save_ptr) {
 void *
 memset (void *dst_, int value, size_t size) {
 	unsigned char *dst = dst_;
+	word_t pattern = (unsigned char) value * 0x0101010101010101ULL;
 
 	ASSERT (dst != NULL || size == 0);
 
+	/* Align the destination, then store whole words. */
+	for (; size > 0 && !word_aligned (dst); size--)
+		*dst++ = value;
+	if (size >= REP_THRESHOLD) {
+		size_t cnt = size / WORD_SIZE;
+		asm volatile ("rep stosq"
+				: "+D" (dst), "+c" (cnt) : "a" (pattern) : "memory");
+		size %= WORD_SIZE;
+	} else {
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			*(word_t *) dst = pattern;
+			dst += WORD_SIZE;
+		}
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
 	return dst_;
 }
 
-/* Returns the length of STRING. */
+/* Returns the length of STRING.
+   Once P is word-aligned, reading a whole word never crosses
+   into the next page, so it is safe to look past the null
+   terminator.  A word contains a zero byte exactly when
+   (W - 0x01...01) & ~W & 0x80...80 is nonzero. */
 size_t
 strlen (const char *string) {
 	const char *p;
 
 	ASSERT (string);
-	// printf("여깅ㄴ잘???\n");
-	for (p = string; *p != '\0'; p++)
+
+	for (p = string; !word_aligned (p); p++)
+		if (*p == '\0')
+			return p - string;
+	for (;; p += WORD_SIZE) {
+		word_t w = *(const word_t *) p;
+		if ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL)
+			break;
+	}
+	for (; *p != '\0'; p++)
 		continue;
 	return p - string;
 }
@@ -54,7 +54,7 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			((uint64_t) ARG2), 0, 0, 0))
 
 #define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3) ( \
-		syscall(((uint64_t *) NUMBER), \
+		syscall(((uint64_t) NUMBER), \
 			((uint64_t) ARG0), \
 			((uint64_t) ARG1), \
 			((uint64_t) ARG2), \
@@ -140,6 +140,51 @@ close (int fd) {
 	syscall1 (SYS_CLOSE, fd);
 }
 
+int
+pread (int fd, void *buffer, unsigned size, off_t offset) {
+	return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, off_t offset) {
+	return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length) {
+	return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+int
+sendfile (int out_fd, int in_fd, unsigned length) {
+	return syscall3 (SYS_SENDFILE, out_fd, in_fd, length);
+}
+
+struct aio_ring *
+aio_setup (void *addr) {
+	return (struct aio_ring *) syscall1 (SYS_AIO_SETUP, addr);
+}
+
+int
+aio_enter (unsigned to_submit, unsigned min_complete) {
+	return syscall2 (SYS_AIO_ENTER, to_submit, min_complete);
+}
+
+int
+pipe (int fds[2]) {
+	return syscall1 (SYS_PIPE, fds);
+}
+
 int
 dup2 (int oldfd, int newfd){
 	return syscall2 (SYS_DUP2, oldfd, newfd);
@@ -0,0 +1,75 @@
+/* Measures sequential write and read throughput for files of
+   doubling size, starting empty and growing by appending, until
+   the file system runs out of space or the largest file an
+   inode can index is reached.  Reports TSC cycles per kilobyte. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 4096
+#define MIN_SIZE (64 * 1024)
+
+static char buf[BLOCK_SIZE];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Writes and reads back a SIZE-byte file.  Returns false if the
+   file could not be written in full. */
+static bool
+run (size_t size)
+{
+  const char *file_name = "bench";
+  uint64_t start, write_cycles, read_cycles;
+  size_t ofs;
+  bool ok = true;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  start = rdtsc ();
+  for (ofs = 0; ofs < size; ofs += BLOCK_SIZE)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      {
+        ok = false;
+        break;
+      }
+  write_cycles = rdtsc () - start;
+
+  if (ok)
+    {
+      seek (fd, 0);
+      start = rdtsc ();
+      for (ofs = 0; ofs < size; ofs += BLOCK_SIZE)
+        if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+          fail ("short read at offset %zu", ofs);
+      read_cycles = rdtsc () - start;
+
+      msg ("%zu kB: write %lld cycles/kB, read %lld cycles/kB",
+           size / 1024, (long long) (write_cycles / (size / 1024)),
+           (long long) (read_cycles / (size / 1024)));
+    }
+  else
+    msg ("%zu kB: file system full after %zu kB", size / 1024, ofs / 1024);
+
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+  return ok;
+}
+
+void
+test_main (void)
+{
+  size_t size;
+
+  for (size = MIN_SIZE; run (size); size *= 2)
+    continue;
+}
@@ -0,0 +1,70 @@
+/* Bounces a byte between two long-lived processes through a pair
+   of pipes and reports the average cost of a process switch in
+   TSC cycles.  Each side blocks reading its pipe until the other
+   writes to it, so every handoff is one switch between address
+   spaces, which makes this sensitive to how much TLB state
+   survives a process switch.  The kernel's "Paging:" line at
+   shutdown shows how many switches kept the TLB. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 1000
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Sends a byte down WRITE_FD and waits for one on READ_FD. */
+static void
+bounce (int write_fd, int read_fd)
+{
+  char c = 'x';
+
+  if (write (write_fd, &c, 1) != 1 || read (read_fd, &c, 1) != 1)
+    fail ("pipe handoff failed");
+}
+
+void
+test_main (void)
+{
+  uint64_t start, cycles;
+  int ping[2], pong[2];
+  pid_t pid;
+  int i;
+
+  CHECK (pipe (ping) == 0, "pipe");
+  CHECK (pipe (pong) == 0, "pipe");
+
+  pid = fork ("pong");
+  if (pid == 0)
+    {
+      char c;
+
+      /* One extra round for the parent's warm-up. */
+      for (i = 0; i <= ROUNDS; i++)
+        if (read (ping[0], &c, 1) != 1 || write (pong[1], &c, 1) != 1)
+          exit (1);
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork failed");
+
+  /* Let the child start up and fault in its pages untimed. */
+  bounce (ping[1], pong[0]);
+
+  start = rdtsc ();
+  for (i = 0; i < ROUNDS; i++)
+    bounce (ping[1], pong[0]);
+  cycles = rdtsc () - start;
+  CHECK (wait (pid) == 0, "wait");
+
+  msg ("%d round trips, %lld cycles per switch",
+       ROUNDS, (long long) (cycles / (2 * ROUNDS)));
+}
@@ -131,6 +131,15 @@ archive_ordinary_file (const char *file_name, int file_fd,
   if (!write_header (file_name, '0', file_size, 0644, archive_fd, write_error))
     return false;
 
+  /* Whole blocks go straight from the file to the archive. */
+  if (file_size >= 512)
+    {
+      int copied = copy_file_range (file_fd, archive_fd,
+                                    file_size - file_size % 512);
+      if (copied > 0)
+        file_size -= copied;
+    }
+
   while (file_size > 0) 
     {
       static char buf[512];
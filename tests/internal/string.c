@@ -0,0 +1,192 @@
+/* Test program for the block and string routines in lib/string.c.
+
+   Checks memcpy, memmove, memset, memcmp, and strlen against
+   simple byte-at-a-time versions for every small size and every
+   combination of source and destination alignment, then times
+   page-sized copies, fills, and compares.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest block checked for correctness. */
+#define MAX_SIZE 600
+
+/* Size of each timed block, and how many times to repeat it. */
+#define BENCH_SIZE 4096
+#define BENCH_ITERS 20000
+
+static unsigned char buf_a[MAX_SIZE + 16];
+static unsigned char buf_b[MAX_SIZE + 16];
+static unsigned char expect[MAX_SIZE + 16];
+static unsigned char bench_src[BENCH_SIZE];
+static unsigned char bench_dst[BENCH_SIZE];
+
+static void fill_random (void);
+static void test_memcpy (void);
+static void test_memmove (void);
+static void test_memset (void);
+static void test_memcmp (void);
+static void test_strlen (void);
+static void benchmark (void);
+
+/* Test the string routines. */
+void
+test (void)
+{
+  random_init (0);
+  test_memcpy ();
+  test_memmove ();
+  test_memset ();
+  test_memcmp ();
+  test_strlen ();
+  printf ("string: PASS\n");
+  benchmark ();
+}
+
+/* Fills buf_a and buf_b with random bytes. */
+static void
+fill_random (void)
+{
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+}
+
+static void
+test_memcpy (void)
+{
+  size_t size, s, d, i;
+
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (s = 0; s < 8; s++)
+      for (d = 0; d < 8; d++)
+        {
+          fill_random ();
+          for (i = 0; i < sizeof buf_b; i++)
+            expect[i] = buf_b[i];
+          for (i = 0; i < size; i++)
+            expect[d + i] = buf_a[s + i];
+
+          ASSERT (memcpy (buf_b + d, buf_a + s, size) == buf_b + d);
+          for (i = 0; i < sizeof buf_b; i++)
+            ASSERT (buf_b[i] == expect[i]);
+        }
+}
+
+static void
+test_memmove (void)
+{
+  size_t size, s, d, i;
+
+  for (size = 0; size <= MAX_SIZE - 16; size++)
+    for (s = 0; s < 16; s++)
+      for (d = 0; d < 16; d++)
+        {
+          fill_random ();
+          for (i = 0; i < sizeof buf_a; i++)
+            expect[i] = buf_a[i];
+          for (i = 0; i < size; i++)
+            expect[d + i] = buf_a[s + i];
+
+          ASSERT (memmove (buf_a + d, buf_a + s, size) == buf_a + d);
+          for (i = 0; i < sizeof buf_a; i++)
+            ASSERT (buf_a[i] == expect[i]);
+        }
+}
+
+static void
+test_memset (void)
+{
+  size_t size, d, i;
+
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (d = 0; d < 8; d++)
+      {
+        int value = random_ulong () & 0x1ff;
+
+        fill_random ();
+        for (i = 0; i < sizeof buf_a; i++)
+          expect[i] = buf_a[i];
+        for (i = 0; i < size; i++)
+          expect[d + i] = value;
+
+        ASSERT (memset (buf_a + d, value, size) == buf_a + d);
+        for (i = 0; i < sizeof buf_a; i++)
+          ASSERT (buf_a[i] == expect[i]);
+      }
+}
+
+static void
+test_memcmp (void)
+{
+  size_t size, diff, s, d, i;
+
+  for (size = 1; size <= 64; size++)
+    for (s = 0; s < 8; s++)
+      for (d = 0; d < 8; d++)
+        {
+          fill_random ();
+          for (i = 0; i < size; i++)
+            buf_b[d + i] = buf_a[s + i];
+          ASSERT (memcmp (buf_a + s, buf_b + d, size) == 0);
+
+          for (diff = 0; diff < size; diff++)
+            {
+              buf_b[d + diff] = buf_a[s + diff] + 1;
+              ASSERT (memcmp (buf_a + s, buf_b + d, size)
+                      == (buf_a[s + diff] > buf_b[d + diff] ? 1 : -1));
+              buf_b[d + diff] = buf_a[s + diff];
+            }
+        }
+}
+
+static void
+test_strlen (void)
+{
+  size_t len, s;
+
+  for (len = 0; len < 64; len++)
+    for (s = 0; s < 8; s++)
+      {
+        memset (buf_a, 'x', sizeof buf_a);
+        buf_a[s + len] = '\0';
+        ASSERT (strlen ((char *) buf_a + s) == len);
+      }
+}
+
+/* Times page-sized operations and prints the elapsed ticks. */
+static void
+benchmark (void)
+{
+  int64_t start;
+  int i;
+
+  random_bytes (bench_src, sizeof bench_src);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERS; i++)
+    memcpy (bench_dst, bench_src, BENCH_SIZE);
+  printf ("memcpy: %d x %d bytes in %lld ticks\n",
+          BENCH_ITERS, BENCH_SIZE, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERS; i++)
+    memset (bench_dst, i, BENCH_SIZE);
+  printf ("memset: %d x %d bytes in %lld ticks\n",
+          BENCH_ITERS, BENCH_SIZE, timer_elapsed (start));
+
+  memcpy (bench_dst, bench_src, BENCH_SIZE);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERS; i++)
+    ASSERT (memcmp (bench_dst, bench_src, BENCH_SIZE) == 0);
+  printf ("memcmp: %d x %d bytes in %lld ticks\n",
+          BENCH_ITERS, BENCH_SIZE, timer_elapsed (start));
+}
@@ -0,0 +1,82 @@
+/* Submits two writes and an fsync with a single aio_enter() call,
+   then reads both regions back through the ring. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING_ADDR ((void *) 0x10000000)
+
+static struct aio_ring *ring;
+
+static void
+queue (int opcode, int fd, void *buf, unsigned len, off_t offset,
+       unsigned long long user_data) 
+{
+  struct aio_sqe *sqe = &ring->sq[ring->sq_tail % AIO_ENTRIES];
+
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->offset = offset;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+}
+
+/* Consumes CNT completions, storing each result in RES at the
+   index given by its user_data. */
+static void
+reap (int res[], unsigned cnt) 
+{
+  unsigned i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct aio_cqe *cqe = &ring->cq[ring->cq_head % AIO_ENTRIES];
+
+      if (ring->cq_head == ring->cq_tail)
+        fail ("only %u of %u completions posted", i, cnt);
+      if (cqe->user_data >= cnt)
+        fail ("unexpected user_data %llu", cqe->user_data);
+      res[cqe->user_data] = cqe->res;
+      ring->cq_head++;
+    }
+}
+
+void
+test_main (void) 
+{
+  static char a[600], b[300], a_back[600], b_back[300];
+  int res[3];
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof a; i++)
+    a[i] = i;
+  for (i = 0; i < sizeof b; i++)
+    b[i] = ~i;
+
+  CHECK (create ("aio.txt", sizeof a + sizeof b), "create \"aio.txt\"");
+  CHECK ((fd = open ("aio.txt")) > 1, "open \"aio.txt\"");
+  CHECK ((ring = aio_setup (RING_ADDR)) == RING_ADDR, "aio_setup");
+
+  queue (AIO_WRITE, fd, a, sizeof a, 0, 0);
+  queue (AIO_WRITE, fd, b, sizeof b, sizeof a, 1);
+  queue (AIO_FSYNC, fd, NULL, 0, 0, 2);
+  CHECK (aio_enter (3, 3) == 3, "submit write, write, fsync");
+  reap (res, 3);
+  if (res[0] != sizeof a || res[1] != sizeof b || res[2] != 0)
+    fail ("completions returned %d, %d, %d", res[0], res[1], res[2]);
+
+  queue (AIO_READ, fd, a_back, sizeof a_back, 0, 0);
+  queue (AIO_READ, fd, b_back, sizeof b_back, sizeof a, 1);
+  CHECK (aio_enter (2, 2) == 2, "submit read, read");
+  reap (res, 2);
+  if (res[0] != sizeof a || res[1] != sizeof b)
+    fail ("completions returned %d, %d", res[0], res[1]);
+  if (memcmp (a, a_back, sizeof a) || memcmp (b, b_back, sizeof b))
+    fail ("read back different data than was written");
+  msg ("read back what was written");
+}
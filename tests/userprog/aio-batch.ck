@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-batch) begin
+(aio-batch) create "aio.txt"
+(aio-batch) open "aio.txt"
+(aio-batch) aio_setup
+(aio-batch) submit write, write, fsync
+(aio-batch) submit read, read
+(aio-batch) read back what was written
+(aio-batch) end
+aio-batch: exit(0)
+EOF
+pass;
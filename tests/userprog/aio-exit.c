@@ -0,0 +1,65 @@
+/* A child queues writes and an fsync, then exits without waiting
+   for any of them.  Exit must wait for the writes to finish, so
+   the parent finds all of the data in the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING_ADDR ((void *) 0x10000000)
+#define CHUNK 512
+#define CHUNK_CNT 8
+
+static char data[CHUNK * CHUNK_CNT];
+
+static void
+child (void) 
+{
+  struct aio_ring *ring;
+  int fd;
+  int i;
+
+  fd = open ("aio.txt");
+  ring = aio_setup (RING_ADDR);
+  if (fd < 2 || ring != RING_ADDR)
+    exit (1);
+
+  for (i = 0; i <= CHUNK_CNT; i++)
+    {
+      struct aio_sqe *sqe = &ring->sq[ring->sq_tail % AIO_ENTRIES];
+
+      sqe->opcode = i < CHUNK_CNT ? AIO_WRITE : AIO_FSYNC;
+      sqe->fd = fd;
+      sqe->buf = i < CHUNK_CNT ? data + i * CHUNK : NULL;
+      sqe->len = i < CHUNK_CNT ? CHUNK : 0;
+      sqe->offset = i < CHUNK_CNT ? i * CHUNK : 0;
+      sqe->user_data = i;
+      ring->sq_tail++;
+    }
+  if (aio_enter (CHUNK_CNT + 1, 0) != CHUNK_CNT + 1)
+    exit (1);
+  exit (0);
+}
+
+void
+test_main (void) 
+{
+  size_t i;
+  int pid;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = i * 7;
+
+  CHECK (create ("aio.txt", sizeof data), "create \"aio.txt\"");
+
+  pid = fork ("child");
+  if (pid == 0)
+    child ();
+  if (pid < 0)
+    fail ("fork failed");
+  if (wait (pid) != 0)
+    fail ("child failed to submit its requests");
+
+  check_file ("aio.txt", data, sizeof data);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-exit) begin
+(aio-exit) create "aio.txt"
+child: exit(0)
+(aio-exit) open "aio.txt" for verification
+(aio-exit) verified contents of "aio.txt"
+(aio-exit) close "aio.txt"
+(aio-exit) end
+aio-exit: exit(0)
+EOF
+pass;
@@ -0,0 +1,68 @@
+/* Opens a file through the ring and reads it with the descriptor
+   that the completion installed.  Opening a missing file must
+   complete with -1. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING_ADDR ((void *) 0x10000000)
+
+static struct aio_ring *ring;
+
+static void
+queue (int opcode, int fd, void *buf, unsigned len, off_t offset,
+       unsigned long long user_data) 
+{
+  struct aio_sqe *sqe = &ring->sq[ring->sq_tail % AIO_ENTRIES];
+
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->offset = offset;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+}
+
+/* Consumes CNT completions, storing each result in RES at the
+   index given by its user_data. */
+static void
+reap (int res[], unsigned cnt) 
+{
+  unsigned i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct aio_cqe *cqe = &ring->cq[ring->cq_head % AIO_ENTRIES];
+
+      if (ring->cq_head == ring->cq_tail)
+        fail ("only %u of %u completions posted", i, cnt);
+      if (cqe->user_data >= cnt)
+        fail ("unexpected user_data %llu", cqe->user_data);
+      res[cqe->user_data] = cqe->res;
+      ring->cq_head++;
+    }
+}
+
+void
+test_main (void) 
+{
+  int res[2];
+
+  CHECK ((ring = aio_setup (RING_ADDR)) == RING_ADDR, "aio_setup");
+
+  queue (AIO_OPEN, 0, (void *) "sample.txt", 0, 0, 0);
+  queue (AIO_OPEN, 0, (void *) "no-such-file", 0, 0, 1);
+  CHECK (aio_enter (2, 2) == 2, "submit two opens");
+  reap (res, 2);
+  if (res[1] != -1)
+    fail ("opening a missing file completed with %d", res[1]);
+  if (res[0] < 2)
+    fail ("opening \"sample.txt\" completed with %d", res[0]);
+  msg ("open completion installed a descriptor");
+
+  check_file_handle (res[0], "sample.txt", sample, sizeof sample - 1);
+  close (res[0]);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-open) begin
+(aio-open) aio_setup
+(aio-open) submit two opens
+(aio-open) open completion installed a descriptor
+(aio-open) verified contents of "sample.txt"
+(aio-open) end
+aio-open: exit(0)
+EOF
+pass;
@@ -0,0 +1,63 @@
+/* Copies part of one file into another with copy_file_range(),
+   then sends the first line of it to the console with
+   sendfile().  Each must copy the right bytes and advance the
+   position of both descriptors.  Finally, copies between
+   overlapping ranges of one file must be refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[10 + 100];
+  int in, out, twin;
+  int byte_cnt;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((out = open ("copy.txt")) > 1, "open \"copy.txt\"");
+  CHECK (write (out, "0123456789", 10) == 10, "write \"copy.txt\"");
+
+  seek (in, 20);
+  byte_cnt = copy_file_range (in, out, 100);
+  if (byte_cnt != 100)
+    fail ("copy_file_range() returned %d instead of 100", byte_cnt);
+  if (tell (in) != 120 || tell (out) != 110)
+    fail ("positions are %u and %u instead of 120 and 110",
+          tell (in), tell (out));
+  msg ("copy_file_range advanced both positions");
+
+  memcpy (expected, "0123456789", 10);
+  memcpy (expected + 10, sample + 20, 100);
+  check_file ("copy.txt", expected, sizeof expected);
+
+  /* The first line of sample.txt is 72 bytes long. */
+  seek (in, 0);
+  byte_cnt = sendfile (1, in, 72);
+  if (byte_cnt != 72)
+    fail ("sendfile() returned %d instead of 72", byte_cnt);
+  if (tell (in) != 72)
+    fail ("position is %u instead of 72", tell (in));
+  msg ("sendfile advanced the input position");
+
+  CHECK ((twin = open ("copy.txt")) > 1, "open \"copy.txt\" again");
+  seek (twin, 50);
+  if (copy_file_range (out, out, 10) != -1)
+    fail ("copy_file_range() within one descriptor succeeded");
+  seek (out, 0);
+  if (copy_file_range (out, twin, 100) != -1)
+    fail ("copy_file_range() between overlapping ranges succeeded");
+  if (tell (out) != 0 || tell (twin) != 50)
+    fail ("a refused copy moved the positions");
+  msg ("copy_file_range refused overlapping ranges");
+
+  byte_cnt = copy_file_range (out, twin, 50);
+  if (byte_cnt != 50)
+    fail ("copy_file_range() returned %d instead of 50", byte_cnt);
+  memcpy (expected + 50, expected, 50);
+  check_file ("copy.txt", expected, sizeof expected);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-file-range) begin
+(copy-file-range) open "sample.txt"
+(copy-file-range) create "copy.txt"
+(copy-file-range) open "copy.txt"
+(copy-file-range) write "copy.txt"
+(copy-file-range) copy_file_range advanced both positions
+(copy-file-range) open "copy.txt" for verification
+(copy-file-range) verified contents of "copy.txt"
+(copy-file-range) close "copy.txt"
+"KAIST is the first and top science and technology university in Korea.
+(copy-file-range) sendfile advanced the input position
+(copy-file-range) open "copy.txt" again
+(copy-file-range) copy_file_range refused overlapping ranges
+(copy-file-range) open "copy.txt" for verification
+(copy-file-range) verified contents of "copy.txt"
+(copy-file-range) close "copy.txt"
+(copy-file-range) end
+copy-file-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Passes bytes through a pipe.  Then checks that each end refuses
+   the other end's operation, that positional I/O on a pipe fails,
+   and that closing the write end gives the reader end of file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int fds[2];
+
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK (write (fds[1], "KAIST", 5) == 5, "write 5 bytes to the write end");
+  if (read (fds[0], buf, sizeof buf) != 5 || memcmp (buf, "KAIST", 5))
+    fail ("read back the wrong bytes");
+  msg ("read them from the read end");
+
+  if (read (fds[1], buf, 1) != -1)
+    fail ("read from the write end succeeded");
+  if (write (fds[0], "x", 1) != -1)
+    fail ("write to the read end succeeded");
+  if (pread (fds[0], buf, 1, 0) != -1 || pwrite (fds[1], "x", 1, 0) != -1)
+    fail ("positional I/O on a pipe succeeded");
+  msg ("wrong-end and positional I/O fail");
+
+  close (fds[1]);
+  if (read (fds[0], buf, sizeof buf) != 0)
+    fail ("no end of file after the write end closed");
+  msg ("end of file once the write end is closed");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe) begin
+(pipe) pipe
+(pipe) write 5 bytes to the write end
+(pipe) read them from the read end
+(pipe) wrong-end and positional I/O fail
+(pipe) end of file once the write end is closed
+(pipe) end
+pipe: exit(0)
+EOF
+pass;
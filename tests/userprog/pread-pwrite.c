@@ -0,0 +1,44 @@
+/* Reads and writes at explicit offsets with pread and pwrite,
+   which must leave the file position where seek put it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[32];
+  int handle;
+  int byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  seek (handle, 10);
+
+  byte_cnt = pread (handle, buf, sizeof buf, 100);
+  if (byte_cnt != sizeof buf)
+    fail ("pread() returned %d instead of %zu", byte_cnt, sizeof buf);
+  if (memcmp (buf, sample + 100, sizeof buf))
+    fail ("pread() read the wrong bytes");
+  if (tell (handle) != 10)
+    fail ("pread() moved the file position to %u", tell (handle));
+  msg ("pread at offset 100");
+
+  byte_cnt = pwrite (handle, "KAIST", 5, 50);
+  if (byte_cnt != 5)
+    fail ("pwrite() returned %d instead of 5", byte_cnt);
+  if (tell (handle) != 10)
+    fail ("pwrite() moved the file position to %u", tell (handle));
+  msg ("pwrite at offset 50");
+
+  memcpy (sample + 50, "KAIST", 5);
+  byte_cnt = read (handle, buf, sizeof buf);
+  if (byte_cnt != sizeof buf || memcmp (buf, sample + 10, sizeof buf))
+    fail ("read() after pread and pwrite did not start at offset 10");
+  msg ("read from the seek position");
+
+  seek (handle, 0);
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+}
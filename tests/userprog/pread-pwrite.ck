@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) pread at offset 100
+(pread-pwrite) pwrite at offset 50
+(pread-pwrite) read from the seek position
+(pread-pwrite) verified contents of "sample.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
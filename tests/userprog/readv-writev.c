@@ -0,0 +1,59 @@
+/* Gathers a file from three buffers with writev and scatters it
+   back into three others with readv, with the middle buffer of
+   each call spanning two pages in virtual address space. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static char tail[sizeof sample];
+  char head[30];
+  struct iovec iov[3];
+  char *sample_p;
+  char *mid;
+  int handle;
+  int byte_cnt;
+
+  sample_p = copy_string_across_boundary (sample);
+  CHECK (create ("iov.txt", 0), "create \"iov.txt\"");
+  CHECK ((handle = open ("iov.txt")) > 1, "open \"iov.txt\"");
+
+  iov[0].iov_base = sample_p;
+  iov[0].iov_len = 50;
+  iov[1].iov_base = sample_p + 50;
+  iov[1].iov_len = 200;
+  iov[2].iov_base = sample_p + 250;
+  iov[2].iov_len = sizeof sample - 1 - 250;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  msg ("writev three buffers");
+
+  /* Reuse the page boundary for the scatter side. */
+  mid = (char *) get_boundary_area () - 100;
+  memset (mid, 0, 200);
+  seek (handle, 0);
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof head;
+  iov[1].iov_base = mid;
+  iov[1].iov_len = 200;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof tail;
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  if (memcmp (head, sample, sizeof head)
+      || memcmp (mid, sample + sizeof head, 200)
+      || memcmp (tail, sample + sizeof head + 200,
+                 sizeof sample - 1 - sizeof head - 200))
+    fail ("readv() scattered the wrong bytes");
+  msg ("readv three buffers");
+
+  check_file ("iov.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "iov.txt"
+(readv-writev) open "iov.txt"
+(readv-writev) writev three buffers
+(readv-writev) readv three buffers
+(readv-writev) open "iov.txt" for verification
+(readv-writev) verified contents of "iov.txt"
+(readv-writev) close "iov.txt"
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,96 @@
+/* Runs two processes at once, each holding its own values in the
+   SSE registers while the other is scheduled, and checks that
+   neither sees the other's.  Also checks that compiler-generated
+   floating-point code works. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Iterations to spin, enough to be preempted many times. */
+#define SPIN_LOOPS 50000000
+
+/* Loads xmm0 through xmm7 from IN, spins for SPIN_LOOPS
+   iterations without touching them, and stores them to OUT. */
+static void
+spin_with_xmm (const uint64_t in[16], uint64_t out[16])
+{
+  uint64_t loops = SPIN_LOOPS;
+
+  asm volatile ("movdqu 0(%1), %%xmm0\n\t"
+                "movdqu 16(%1), %%xmm1\n\t"
+                "movdqu 32(%1), %%xmm2\n\t"
+                "movdqu 48(%1), %%xmm3\n\t"
+                "movdqu 64(%1), %%xmm4\n\t"
+                "movdqu 80(%1), %%xmm5\n\t"
+                "movdqu 96(%1), %%xmm6\n\t"
+                "movdqu 112(%1), %%xmm7\n\t"
+                "1: dec %0\n\t"
+                "jnz 1b\n\t"
+                "movdqu %%xmm0, 0(%2)\n\t"
+                "movdqu %%xmm1, 16(%2)\n\t"
+                "movdqu %%xmm2, 32(%2)\n\t"
+                "movdqu %%xmm3, 48(%2)\n\t"
+                "movdqu %%xmm4, 64(%2)\n\t"
+                "movdqu %%xmm5, 80(%2)\n\t"
+                "movdqu %%xmm6, 96(%2)\n\t"
+                "movdqu %%xmm7, 112(%2)"
+                : "+r" (loops)
+                : "r" (in), "r" (out)
+                : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6",
+                  "xmm7", "cc", "memory");
+}
+
+/* Returns true if values derived from SEED survive a stay in the
+   SSE registers. */
+static bool
+xmm_survives (uint64_t seed)
+{
+  uint64_t in[16], out[16];
+  int i;
+
+  for (i = 0; i < 16; i++)
+    in[i] = seed * 0x0101010101010101ULL + i;
+  spin_with_xmm (in, out);
+  for (i = 0; i < 16; i++)
+    if (in[i] != out[i])
+      return false;
+  return true;
+}
+
+/* Adds up N halves in floating point. */
+static double
+sum_halves (int n)
+{
+  double sum = 0.0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    sum += 0.5;
+  return sum;
+}
+
+void
+test_main (void)
+{
+  bool ok;
+  int pid;
+
+  pid = fork ("child");
+  if (pid == 0)
+    exit (xmm_survives (0x5a) && sum_halves (1000) == 500.0 ? 0 : 1);
+  if (pid < 0)
+    fail ("fork failed");
+
+  ok = xmm_survives (0xa5);
+  if (wait (pid) != 0)
+    fail ("child's SSE registers changed");
+  if (!ok)
+    fail ("parent's SSE registers changed");
+  msg ("both processes kept their SSE registers");
+
+  if (sum_halves (1000) != 500.0)
+    fail ("floating-point sum is wrong");
+  msg ("floating point works");
+}
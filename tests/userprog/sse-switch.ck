@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sse-switch) begin
+child: exit(0)
+(sse-switch) both processes kept their SSE registers
+(sse-switch) floating point works
+(sse-switch) end
+sse-switch: exit(0)
+EOF
+pass;
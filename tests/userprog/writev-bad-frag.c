@@ -0,0 +1,42 @@
+/* Passes writev a valid first buffer and an invalid second one.
+   The child must be terminated with -1 exit code before any of
+   the first buffer reaches the file. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static char data[100] = "KAIST";
+  int handle;
+  int pid;
+
+  CHECK (create ("iov.txt", 0), "create \"iov.txt\"");
+
+  pid = fork ("child");
+  if (pid == 0)
+    {
+      struct iovec iov[2];
+
+      handle = open ("iov.txt");
+      if (handle < 2)
+        exit (1);
+      iov[0].iov_base = data;
+      iov[0].iov_len = sizeof data;
+      iov[1].iov_base = (void *) 0x10123420;
+      iov[1].iov_len = 123;
+      writev (handle, iov, 2);
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork failed");
+  if (wait (pid) != -1)
+    fail ("child was not killed");
+
+  CHECK ((handle = open ("iov.txt")) > 1, "open \"iov.txt\"");
+  if (filesize (handle) != 0)
+    fail ("\"iov.txt\" is %d bytes long, not empty", filesize (handle));
+  msg ("nothing was written");
+}
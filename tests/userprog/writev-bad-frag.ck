@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-bad-frag) begin
+(writev-bad-frag) create "iov.txt"
+child: exit(-1)
+(writev-bad-frag) open "iov.txt"
+(writev-bad-frag) nothing was written
+(writev-bad-frag) end
+writev-bad-frag: exit(0)
+EOF
+pass;
@@ -0,0 +1,176 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Lazy FPU/SSE context switching.
+
+   The x87, MMX, and SSE registers are saved and restored with
+   FXSAVE/FXRSTOR, but only when a thread actually uses them.
+   Each context switch sets CR0.TS unless the incoming thread
+   already owns the register contents, so the first
+   floating-point or SIMD instruction it executes raises #NM.
+   The #NM handler saves the previous owner's registers into
+   that thread's state area, loads the current thread's, and
+   clears CR0.TS.  Threads that never touch the FPU, which
+   includes every kernel thread, never pay for it.
+
+   A thread's state area is allocated on its first #NM and
+   starts out as the processor's reset state, so registers never
+   leak from one process to another.
+
+   Kernel code is built with -mno-sse and never touches the FPU,
+   so a #NM from kernel mode is a bug. */
+
+/* CR0 bits. */
+#define CR0_MP (1 << 1)       /* Monitor coprocessor. */
+#define CR0_EM (1 << 2)       /* x87 emulation. */
+#define CR0_TS (1 << 3)       /* Task switched. */
+#define CR0_NE (1 << 5)       /* Native x87 error reporting. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR (1 << 9)       /* FXSAVE/FXRSTOR and SSE. */
+#define CR4_OSXMMEXCPT (1 << 10)  /* Unmasked SSE exceptions raise #XF. */
+
+/* Thread whose state is loaded in the FPU registers, or null if
+   the registers hold nothing worth saving. */
+static struct thread *fpu_owner;
+
+/* State a thread sees on its first FPU instruction: all x87
+   exceptions masked, all SSE exceptions masked, registers zero. */
+static uint8_t initial_state[FPU_STATE_SIZE]
+	__attribute__ ((aligned (FPU_STATE_ALIGN)));
+
+static void fpu_trap (struct intr_frame *);
+
+/* Sets CR0.TS, so the next FPU instruction raises #NM. */
+static inline void
+stts (void) {
+	lcr0 (rcr0 () | CR0_TS);
+}
+
+/* Returns T's FXSAVE area, which must have been allocated. */
+static inline void *
+fpu_state (struct thread *t) {
+	ASSERT (t->fpu_area != NULL);
+	return (void *) ROUND_UP ((uintptr_t) t->fpu_area, FPU_STATE_ALIGN);
+}
+
+static inline void
+fxsave (void *state) {
+	asm volatile ("fxsave64 (%0)" : : "r" (state) : "memory");
+}
+
+static inline void
+fxrstor (const void *state) {
+	asm volatile ("fxrstor64 (%0)" : : "r" (state) : "memory");
+}
+
+/* Enables FXSAVE and SSE and installs the #NM handler. */
+void
+fpu_init (void) {
+	*(uint16_t *) (initial_state + 0) = 0x037f;     /* FCW. */
+	*(uint32_t *) (initial_state + 24) = 0x1f80;    /* MXCSR. */
+
+	lcr4 (rcr4 () | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	lcr0 ((rcr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+
+	intr_register_int (7, 0, INTR_ON, fpu_trap,
+			"#NM Device Not Available Exception");
+}
+
+/* Arranges for NEXT, which is about to run, to trap on its first
+   FPU instruction unless its state is already loaded.
+   Interrupts must be off. */
+void
+fpu_switch (struct thread *next) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (next == fpu_owner)
+		clts ();
+	else
+		stts ();
+}
+
+/* #NM handler: loads the running thread's FPU state. */
+static void
+fpu_trap (struct intr_frame *f) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	if ((f->cs & 3) == 0) {
+		intr_dump_frame (f);
+		PANIC ("FPU used in kernel");
+	}
+
+	if (cur->fpu_area == NULL) {
+		cur->fpu_area = malloc (FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+		if (cur->fpu_area == NULL) {
+			printf ("%s: out of memory for FPU state\n", thread_name ());
+#ifdef USERPROG
+			cur->exit_status = -1;
+#endif
+			thread_exit ();
+		}
+		memcpy (fpu_state (cur), initial_state, FPU_STATE_SIZE);
+	}
+
+	/* We may have been preempted above, so the owner is only
+	   stable from here on. */
+	old_level = intr_disable ();
+	clts ();
+	if (fpu_owner != cur) {
+		if (fpu_owner != NULL)
+			fxsave (fpu_state (fpu_owner));
+		fxrstor (fpu_state (cur));
+		fpu_owner = cur;
+	}
+	intr_set_level (old_level);
+}
+
+/* Gives DST a copy of SRC's FPU state, for fork().  SRC must not
+   be running.  Returns false if memory is exhausted. */
+bool
+fpu_copy (struct thread *dst, struct thread *src) {
+	enum intr_level old_level;
+
+	ASSERT (dst->fpu_area == NULL);
+
+	if (src->fpu_area == NULL)
+		return true;
+	dst->fpu_area = malloc (FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+	if (dst->fpu_area == NULL)
+		return false;
+
+	old_level = intr_disable ();
+	if (fpu_owner == src) {
+		clts ();
+		fxsave (fpu_state (src));
+		fpu_switch (thread_current ());
+	}
+	memcpy (fpu_state (dst), fpu_state (src), FPU_STATE_SIZE);
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Throws away T's FPU state, for exec() and exit().  T must be
+   the running thread or not running at all. */
+void
+fpu_discard (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	if (fpu_owner == t) {
+		fpu_owner = NULL;
+		if (t == thread_current ())
+			stts ();
+	}
+	intr_set_level (old_level);
+
+	free (t->fpu_area);
+	t->fpu_area = NULL;
+}
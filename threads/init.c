@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -22,6 +23,7 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #ifdef USERPROG
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
@@ -34,8 +36,12 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -94,6 +100,7 @@ main (void) {
 
 	/* Initialize interrupt handlers. */
 	intr_init ();
+	fpu_init ();
 	timer_init ();
 	kbd_init ();
 	input_init ();
@@ -111,6 +118,9 @@ main (void) {
 	disk_init ();
 	filesys_init (format_filesys);
 #endif
+#ifdef USERPROG
+	aio_init ();
+#endif
 
 #ifdef VM
 	vm_init ();
@@ -165,6 +175,7 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_init_pcid ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -224,6 +235,8 @@ parse_options (char **argv) {
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
+		else if (!strcmp (name, "-kf"))
+			kernel_page_floor = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
 #endif
@@ -328,6 +341,7 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+			"  -kf=COUNT          Keep COUNT kernel pages free of user pages.\n"
 #endif
 			);
 	power_off ();
@@ -354,8 +368,15 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	pml4_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	page_cache_print_stats ();
+	inode_print_stats ();
+	dir_print_stats ();
+	journal_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
@@ -1,13 +1,17 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+static void pcid_release (uint64_t *pml4);
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -191,6 +195,7 @@ pml4_destroy (uint64_t *pml4) {
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
+	pcid_release (pml4);
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
@@ -199,11 +204,114 @@ pml4_destroy (uint64_t *pml4) {
 	palloc_free_page ((void *) pml4);
 }
 
+/* Process-context identifiers.
+ *
+ * With CR4.PCIDE set, the CPU tags TLB entries with the PCID in
+ * the low 12 bits of CR3, and a CR3 load with bit 63 set keeps
+ * the entries of every PCID.  Switching back to a process whose
+ * PCID is still its own therefore costs no TLB refill.
+ *
+ * PCID 0 belongs to base_pml4, whose mappings never change.
+ * PCIDs 1 to PCID_CNT - 1 are handed out round-robin, and
+ * pcid_owner[] records which pml4 each one currently tags.  When
+ * a PCID changes hands, its first CR3 load flushes it, so the new
+ * owner never sees the old owner's entries.  A pml4 that is
+ * destroyed, or modified while it is not loaded, gives up its
+ * PCID for the same reason. */
+#define PCID_CNT 64
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR4_PCIDE (1 << 17)
+#define CPUID_1_ECX_PCID (1 << 17)
+
+static bool pcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];
+static unsigned pcid_next = 1;
+
+/* Statistics. */
+static long long switch_cnt;    /* Calls to pml4_activate(). */
+static long long kept_cnt;      /* Of those, TLB entries kept. */
+static long long assign_cnt;    /* PCIDs assigned or recycled. */
+
+/* Turns on PCIDs if the CPU supports them.  Must be called with
+ * a CR3 whose PCID field is 0. */
+void
+pml4_init_pcid (void) {
+	uint32_t eax = 1, ebx, ecx = 0, edx;
+
+	asm ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if ((ecx & CPUID_1_ECX_PCID) == 0)
+		return;
+
+	ASSERT ((rcr3 () & PGMASK) == 0);
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return (rcr3 () & ~(uint64_t) PGMASK) == vtop (pml4);
+}
+
+/* Takes away PML4's PCID, if it has one, so that the next
+ * pml4_activate() flushes its stale TLB entries. */
+static void
+pcid_release (uint64_t *pml4) {
+	enum intr_level old_level = intr_disable ();
+	for (unsigned pcid = 1; pcid < PCID_CNT; pcid++)
+		if (pcid_owner[pcid] == pml4)
+			pcid_owner[pcid] = NULL;
+	intr_set_level (old_level);
+}
+
 /* Loads page directory PD into the CPU's page directory base
  * register. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t cr3;
+	unsigned pcid;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	cr3 = vtop (pml4);
+
+	old_level = intr_disable ();
+	switch_cnt++;
+	if (pcid_enabled) {
+		if (pml4 == base_pml4)
+			pcid = 0;
+		else {
+			for (pcid = 1; pcid < PCID_CNT; pcid++)
+				if (pcid_owner[pcid] == pml4)
+					break;
+		}
+
+		if (pcid < PCID_CNT) {
+			cr3 |= pcid | CR3_NOFLUSH;
+			kept_cnt++;
+		} else {
+			/* Recycle the next PCID, flushing its old entries. */
+			pcid = pcid_next;
+			pcid_next = pcid_next % (PCID_CNT - 1) + 1;
+			pcid_owner[pcid] = pml4;
+			assign_cnt++;
+			cr3 |= pcid;
+		}
+	}
+	lcr3 (cr3);
+	intr_set_level (old_level);
+}
+
+/* Prints address-space switching statistics. */
+void
+pml4_print_stats (void) {
+	if (pcid_enabled)
+		printf ("Paging: %lld address space switches, %lld kept the TLB, "
+				"%lld PCIDs assigned\n", switch_cnt, kept_cnt, assign_cnt);
+	else
+		printf ("Paging: %lld address space switches, no PCID support\n",
+				switch_cnt);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -257,8 +365,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) upage);
+		else
+			pcid_release (pml4);
 	}
 }
 
@@ -283,8 +393,10 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
+		else
+			pcid_release (pml4);
 	}
 }
 
@@ -309,7 +421,9 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
+		else
+			pcid_release (pml4);
 	}
 }
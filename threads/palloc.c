@@ -9,6 +9,7 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/loader.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -24,13 +25,48 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   The split is only the starting point.  When one pool runs dry,
+   it borrows free pages from the other one, and the pages go
+   back to their home pool when they are freed.  The user pool
+   may never push the kernel pool below kernel_page_floor free
+   pages, so the kernel always has room to evict and to keep
+   running its own bookkeeping under memory pressure.
+
+   Each pool also keeps a small stock of pages that the idle
+   thread has already filled with zeros (see palloc_zero_idle()).
+   Single-page PAL_ZERO requests take a page from this stock
+   first, so they don't pay for the memset on the spot.  Stocked
+   pages are not in the pool's free count, so a request that
+   cannot be met otherwise puts the stock back among the free
+   pages and tries again before it borrows or fails. */
+
+/* Pre-zeroed page watermarks, per pool.  The idle thread starts
+   refilling a pool's stock when it drops below ZERO_LOW_WATER
+   pages and stops once it reaches ZERO_HIGH_WATER. */
+#define ZERO_LOW_WATER 16
+#define ZERO_HIGH_WATER 64
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct bitmap *lent_map;        /* Pages lent to the other pool. */
 	uint8_t *base;                  /* Base of pool. */
+
+	/* Pre-zeroed pages, linked through their first word.
+	   Updated with interrupts off. */
+	void *zero_list;                /* Stack of zeroed pages. */
+	size_t zero_cnt;                /* Number of pages in ZERO_LIST. */
+	bool zero_refill;               /* Refilling up to ZERO_HIGH_WATER? */
+	size_t zero_hit_cnt;            /* PAL_ZERO requests served by it. */
+
+	/* Usage statistics, updated with interrupts off. */
+	size_t free_cnt;                /* Number of free pages. */
+	size_t lent_cnt;                /* Pages lent to the other pool. */
+	size_t peak_cnt;                /* Most pages ever in use at once. */
+	size_t usable_cnt;              /* Pages managed by this pool. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +74,21 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Minimum number of free kernel pages that the user pool may not
+   borrow.  Zero selects a default based on the kernel pool size. */
+size_t kernel_page_floor = 0;
+
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *pool_get_multiple (struct pool *, size_t page_cnt,
+		size_t reserve, bool lend);
+static void *pool_get_zeroed (struct pool *);
+static bool pool_zero_one (struct pool *);
+static bool pool_drain_zeroed (struct pool *);
+static size_t user_pages_in_use (void);
 
 /* multiboot info */
 struct multiboot_info {
@@ -232,6 +279,16 @@ split:
 			}
 		}
 	}
+
+	// Count the usable pages of each pool and fix the kernel floor.
+	kernel_pool.free_cnt = kernel_pool.usable_cnt =
+		bitmap_count (kernel_pool.used_map, 0,
+				bitmap_size (kernel_pool.used_map), false);
+	user_pool.free_cnt = user_pool.usable_cnt =
+		bitmap_count (user_pool.used_map, 0,
+				bitmap_size (user_pool.used_map), false);
+	if (kernel_page_floor == 0)
+		kernel_page_floor = kernel_pool.usable_cnt / 4;
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -255,23 +312,44 @@ palloc_init (void) {
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
+   otherwise from the kernel pool.  If that pool is exhausted, the
+   pages are borrowed from the other pool instead, leaving at
+   least kernel_page_floor free pages in the kernel pool for user
+   requests.  If PAL_ZERO is set in FLAGS, then the pages are
+   filled with zeros; a single zeroed page comes from the pool's
+   pre-zeroed stock when it has one.  Before a request borrows or
+   gives up, the stock of each pool it tries is returned to that
+   pool's free pages.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	void *pages = NULL;
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
+	if (page_cnt == 1 && (flags & PAL_ZERO)) {
+		pages = pool_get_zeroed (pool);
+		if (pages != NULL)
+			return pages;
+	}
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	pages = pool_get_multiple (pool, page_cnt, 0, false);
+	if (pages == NULL && page_cnt == 1)
+		pages = pool_get_zeroed (pool);
+	if (pages == NULL && pool_drain_zeroed (pool))
+		pages = pool_get_multiple (pool, page_cnt, 0, false);
+	if (pages == NULL) {
+		if (flags & PAL_USER) {
+			if (user_pages_in_use () + page_cnt <= user_page_limit) {
+				pool_drain_zeroed (&kernel_pool);
+				pages = pool_get_multiple (&kernel_pool, page_cnt,
+						kernel_page_floor, true);
+			}
+		} else {
+			pool_drain_zeroed (&user_pool);
+			pages = pool_get_multiple (&user_pool, page_cnt, 0, true);
+		}
+	}
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -296,11 +374,13 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
-/* Frees the PAGE_CNT pages starting at PAGES. */
+/* Frees the PAGE_CNT pages starting at PAGES.
+   Borrowed pages return to the pool they were lent from. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -319,7 +399,16 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+
+	old_level = intr_disable ();
+	if (bitmap_test (pool->lent_map, page_idx)) {
+		ASSERT (bitmap_all (pool->lent_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->lent_map, page_idx, page_cnt, false);
+		pool->lent_cnt -= page_cnt;
+	}
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool->free_cnt += page_cnt;
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +417,156 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page for the pre-zeroed stock of a pool that
+   has dropped below its low watermark.  Called by the idle
+   thread with interrupts on.  Never blocks: gives up if a pool
+   lock is busy.  Returns true if a page was zeroed and more work
+   may remain, false if there is nothing left to do for now. */
+bool
+palloc_zero_idle (void) {
+	ASSERT (intr_get_level () == INTR_ON);
+
+	return pool_zero_one (&user_pool) || pool_zero_one (&kernel_pool);
+}
+
+/* Prints a pool's usage statistics under NAME. */
+static void
+print_pool_stats (const char *name, const struct pool *p) {
+	printf ("%s: %zu of %zu pages in use, %zu peak, %zu lent, "
+			"%zu pre-zeroed (%zu hits)\n",
+			name, p->usable_cnt - p->free_cnt - p->zero_cnt, p->usable_cnt,
+			p->peak_cnt, p->lent_cnt, p->zero_cnt, p->zero_hit_cnt);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	print_pool_stats ("Kernel pool", &kernel_pool);
+	print_pool_stats ("User pool", &user_pool);
+	printf ("User pages: %zu in use, %zu borrowed from kernel pool\n",
+			user_pages_in_use (), kernel_pool.lent_cnt);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, as long as at
+   least RESERVE free pages remain in POOL afterward.  If LEND is
+   true, the pages are recorded as lent to the other pool.
+   Returns the first page, or a null pointer on failure. */
+static void *
+pool_get_multiple (struct pool *pool, size_t page_cnt, size_t reserve,
+		bool lend) {
+	enum intr_level old_level;
+	size_t page_idx = BITMAP_ERROR;
+
+	lock_acquire (&pool->lock);
+	if (pool->free_cnt >= page_cnt + reserve)
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	if (page_idx != BITMAP_ERROR) {
+		old_level = intr_disable ();
+		pool->free_cnt -= page_cnt;
+		if (pool->usable_cnt - pool->free_cnt - pool->zero_cnt > pool->peak_cnt)
+			pool->peak_cnt = pool->usable_cnt - pool->free_cnt - pool->zero_cnt;
+		if (lend) {
+			bitmap_set_multiple (pool->lent_map, page_idx, page_cnt, true);
+			pool->lent_cnt += page_cnt;
+		}
+		intr_set_level (old_level);
+	}
+	lock_release (&pool->lock);
+
+	return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Pops a page from POOL's pre-zeroed stock.
+   Returns the page, or a null pointer if the stock is empty. */
+static void *
+pool_get_zeroed (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	void **page = pool->zero_list;
+
+	if (page != NULL) {
+		pool->zero_list = *page;
+		pool->zero_cnt--;
+		pool->zero_hit_cnt++;
+		if (pool->usable_cnt - pool->free_cnt - pool->zero_cnt > pool->peak_cnt)
+			pool->peak_cnt = pool->usable_cnt - pool->free_cnt - pool->zero_cnt;
+		*page = NULL;
+	}
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Moves one free page of POOL into its pre-zeroed stock, if the
+   stock is being refilled and POOL has pages to spare.
+   Returns true if a page was added. */
+static bool
+pool_zero_one (struct pool *pool) {
+	enum intr_level old_level;
+	size_t page_idx = BITMAP_ERROR;
+	void **page;
+
+	if (pool->zero_cnt < ZERO_LOW_WATER)
+		pool->zero_refill = true;
+	else if (pool->zero_cnt >= ZERO_HIGH_WATER)
+		pool->zero_refill = false;
+	if (!pool->zero_refill || pool->free_cnt <= ZERO_HIGH_WATER)
+		return false;
+
+	if (!lock_try_acquire (&pool->lock))
+		return false;
+	page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+	if (page_idx != BITMAP_ERROR) {
+		old_level = intr_disable ();
+		pool->free_cnt--;
+		pool->zero_cnt++;
+		intr_set_level (old_level);
+	}
+	lock_release (&pool->lock);
+	if (page_idx == BITMAP_ERROR)
+		return false;
+
+	/* The page is counted in ZERO_CNT but not on the list yet, so
+	   nobody else can see it while it is being cleared. */
+	page = (void **) (pool->base + PGSIZE * page_idx);
+	memset (page, 0, PGSIZE);
+
+	old_level = intr_disable ();
+	*page = pool->zero_list;
+	pool->zero_list = page;
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Returns every page in POOL's pre-zeroed stock to its free
+   pages, so that contiguous requests and the borrowing reserve
+   can count on them.  Returns true if any page was returned. */
+static bool
+pool_drain_zeroed (struct pool *pool) {
+	enum intr_level old_level;
+	bool drained = false;
+	void **page;
+
+	lock_acquire (&pool->lock);
+	old_level = intr_disable ();
+	while ((page = pool->zero_list) != NULL) {
+		pool->zero_list = *page;
+		pool->zero_cnt--;
+		pool->free_cnt++;
+		bitmap_reset (pool->used_map, pg_no (page) - pg_no (pool->base));
+		drained = true;
+	}
+	intr_set_level (old_level);
+	lock_release (&pool->lock);
+	return drained;
+}
+
+/* Returns the number of pages currently handed out for user
+   memory, counting pages borrowed from the kernel pool. */
+static size_t
+user_pages_in_use (void) {
+	return user_pool.usable_cnt - user_pool.free_cnt - user_pool.zero_cnt
+		- user_pool.lent_cnt + kernel_pool.lent_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -339,12 +578,14 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->lent_map = bitmap_create_in_buf (pgcnt, *bm_base + bm_pages, bm_pages);
 	p->base = (void *) start;
 
-	// Mark all to unusable.
+	// Mark all to unusable, and nothing is lent yet.
 	bitmap_set_all(p->used_map, true);
+	bitmap_set_all(p->lent_map, false);
 
-	*bm_base += bm_pages;
+	*bm_base += bm_pages * 2;
 }
 
 /* Returns true if PAGE was allocated from POOL,
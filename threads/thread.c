@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
@@ -498,6 +499,16 @@ idle (void *idle_started_ UNUSED) {
 		intr_disable ();
 		thread_block ();
 
+		/* Nobody else wants the CPU, so spend the time filling the
+		   page allocator's pre-zeroed stock, one page at a time,
+		   until a thread becomes ready or there is nothing to do. */
+		intr_enable ();
+		while (list_empty (&ready_list) && palloc_zero_idle ())
+			continue;
+		intr_disable ();
+		if (!list_empty (&ready_list))
+			continue;
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -729,6 +740,7 @@ schedule (void) {
 	/* Activate the new address space. */
 	process_activate (next);
 #endif
+	fpu_switch (next);
 
 	if (curr != next) {
 		/* If the thread we switched from is dying, destroy its struct
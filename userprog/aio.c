@@ -0,0 +1,389 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Asynchronous I/O.
+
+   A process sets up one ring page with aio_setup(), which maps it
+   at a user address; the kernel keeps its own mapping of the same
+   frame.  aio_enter() consumes submissions, hands each to a pool
+   of worker threads, and publishes finished ones to the
+   completion queue, waiting for some if asked to.
+
+   Workers run without the process's address space, so user
+   memory is only touched in the process's own context: write data
+   and file names are copied in at submission, and read data is
+   copied out when its completion is published.  Each transfer is
+   staged through one kernel page, so a single entry moves at most
+   PGSIZE bytes.  Files are reopened at submission, which keeps an
+   operation safe from a concurrent close() of its descriptor. */
+
+/* Worker threads shared by all processes. */
+#define AIO_WORKERS 4
+
+/* A process's asynchronous I/O state. */
+struct aio_ctx {
+	struct aio_ring *ring;      /* Kernel mapping of the ring page. */
+	unsigned outstanding;       /* Submitted but not yet published. */
+
+	struct lock lock;           /* Protects the members below. */
+	struct condition done_cond; /* Signaled when a request finishes. */
+	struct list done;           /* Finished requests, in order. */
+	unsigned inflight;          /* Queued or running requests. */
+};
+
+/* One submitted operation. */
+struct aio_req {
+	struct list_elem elem;      /* In the work queue or a done list. */
+	struct aio_ctx *ctx;        /* Owner. */
+	struct aio_sqe sqe;         /* Copy of the submission. */
+	struct file *file;          /* File to use, or file opened. */
+	struct dir *cwd;            /* Working directory for AIO_OPEN. */
+	void *kbuf;                 /* Staging page, or file name. */
+	int res;                    /* Result. */
+};
+
+/* Requests waiting for a worker. */
+static struct list work_queue;
+static struct lock work_lock;
+static struct condition work_cond;
+
+static void worker (void *);
+
+/* Starts the worker threads. */
+void
+aio_init (void) {
+	int i;
+
+	list_init (&work_queue);
+	lock_init (&work_lock);
+	cond_init (&work_cond);
+	for (i = 0; i < AIO_WORKERS; i++)
+		thread_create ("aio", PRI_DEFAULT, worker, NULL);
+}
+
+/* Maps a zeroed ring page at ADDR, which must be a page-aligned
+   user address with nothing mapped there, and returns ADDR.
+   Returns a null pointer on failure or if the process already has
+   a ring. */
+void *
+aio_setup (void *addr) {
+	struct thread *t = thread_current ();
+	struct aio_ctx *ctx;
+	void *kpage;
+
+	ASSERT (sizeof (struct aio_ring) <= PGSIZE);
+
+	if (t->aio != NULL || addr == NULL || pg_ofs (addr) != 0
+			|| !is_user_vaddr (addr) || pml4_get_page (t->pml4, addr) != NULL)
+		return NULL;
+
+	ctx = malloc (sizeof *ctx);
+	if (ctx == NULL)
+		return NULL;
+#ifdef VM
+	if (spt_find_page (&t->spt, addr) != NULL
+			|| !vm_alloc_page (VM_ANON, addr, true) || !vm_claim_page (addr)) {
+		free (ctx);
+		return NULL;
+	}
+	kpage = pml4_get_page (t->pml4, addr);
+#else
+	kpage = palloc_get_page (PAL_USER);
+	if (kpage == NULL || !pml4_set_page (t->pml4, addr, kpage, true)) {
+		palloc_free_page (kpage);
+		free (ctx);
+		return NULL;
+	}
+#endif
+	memset (kpage, 0, PGSIZE);
+
+	ctx->ring = kpage;
+	ctx->outstanding = 0;
+	lock_init (&ctx->lock);
+	cond_init (&ctx->done_cond);
+	list_init (&ctx->done);
+	ctx->inflight = 0;
+	t->aio = ctx;
+	return addr;
+}
+
+/* Frees REQ and whatever it still holds. */
+static void
+req_free (struct aio_req *req) {
+	if (req->file != NULL)
+		file_close (req->file);
+	if (req->kbuf != NULL)
+		palloc_free_page (req->kbuf);
+	dir_close (req->cwd);
+	free (req);
+}
+
+/* Takes what REQ needs from the running process: its file, its
+   data or file name, its working directory.  Returns false if the
+   submission is malformed, in which case REQ completes at once
+   with an error. */
+static bool
+prepare (struct aio_req *req) {
+	struct aio_sqe *sqe = &req->sqe;
+	struct thread *t = thread_current ();
+	int64_t len;
+
+	switch (sqe->opcode) {
+		case AIO_READ:
+		case AIO_WRITE:
+			if (!is_valid_fd (sqe->fd) || sqe->offset < 0)
+				return false;
+			if (sqe->len > PGSIZE)
+				sqe->len = PGSIZE;
+			req->kbuf = palloc_get_page (0);
+			if (req->kbuf == NULL)
+				return false;
+			if (sqe->opcode == AIO_WRITE
+					&& !copyin (req->kbuf, sqe->buf, sqe->len))
+				return false;
+			req->file = file_reopen (t->fd_table[sqe->fd]);
+			return req->file != NULL;
+
+		case AIO_FSYNC:
+			return is_valid_fd (sqe->fd);
+
+		case AIO_OPEN:
+			req->kbuf = palloc_get_page (0);
+			if (req->kbuf == NULL)
+				return false;
+			len = strncpy_from_user (req->kbuf, sqe->buf, PGSIZE);
+			if (len < 0 || len == PGSIZE)
+				return false;
+			if (t->cwd != NULL)
+				req->cwd = dir_reopen (t->cwd);
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+/* Returns the number of completions the process has not yet
+   consumed. */
+static unsigned
+cq_used (const struct aio_ring *ring) {
+	return ring->cq_tail - ring->cq_head;
+}
+
+/* Consumes up to TO_SUBMIT entries from CTX's submission queue.
+   Stops early if the completion queue could not take them all.
+   Returns the number consumed, or -1 if the queue indexes are
+   corrupt. */
+static int
+submit (struct aio_ctx *ctx, unsigned to_submit) {
+	struct aio_ring *ring = ctx->ring;
+	unsigned head = ring->sq_head;
+	unsigned tail = ring->sq_tail;
+	unsigned n = 0;
+
+	if (tail - head > AIO_ENTRIES)
+		return -1;
+	barrier ();
+
+	while (n < to_submit && head != tail
+			&& ctx->outstanding + cq_used (ring) < AIO_ENTRIES) {
+		struct aio_req *req = calloc (1, sizeof *req);
+
+		if (req == NULL)
+			break;
+		req->ctx = ctx;
+		req->sqe = ring->sq[head % AIO_ENTRIES];
+		head++;
+		n++;
+		ctx->outstanding++;
+
+		if (prepare (req)) {
+			lock_acquire (&ctx->lock);
+			ctx->inflight++;
+			lock_release (&ctx->lock);
+
+			lock_acquire (&work_lock);
+			list_push_back (&work_queue, &req->elem);
+			cond_signal (&work_cond, &work_lock);
+			lock_release (&work_lock);
+		} else {
+			req->res = -1;
+			lock_acquire (&ctx->lock);
+			list_push_back (&ctx->done, &req->elem);
+			lock_release (&ctx->lock);
+		}
+	}
+	ring->sq_head = head;
+	return n;
+}
+
+/* Finishes REQ in the process's context and fills in CQE. */
+static void
+complete (struct aio_req *req, struct aio_cqe *cqe) {
+	int res = req->res;
+
+	if (res > 0 && req->sqe.opcode == AIO_READ
+			&& !copyout (req->sqe.buf, req->kbuf, res))
+		res = -1;
+	if (res == 0 && req->sqe.opcode == AIO_OPEN) {
+		res = fd_install (req->file);
+		if (res >= 0)
+			req->file = NULL;
+	}
+	cqe->user_data = req->sqe.user_data;
+	cqe->res = res;
+	cqe->pad = 0;
+}
+
+/* Moves finished requests to CTX's completion queue while it has
+   room. */
+static void
+publish (struct aio_ctx *ctx) {
+	struct aio_ring *ring = ctx->ring;
+
+	while (cq_used (ring) < AIO_ENTRIES) {
+		struct aio_req *req;
+
+		lock_acquire (&ctx->lock);
+		if (list_empty (&ctx->done)) {
+			lock_release (&ctx->lock);
+			break;
+		}
+		req = list_entry (list_pop_front (&ctx->done), struct aio_req, elem);
+		lock_release (&ctx->lock);
+
+		complete (req, &ring->cq[ring->cq_tail % AIO_ENTRIES]);
+		barrier ();
+		ring->cq_tail++;
+		ctx->outstanding--;
+		req_free (req);
+	}
+}
+
+/* Submits up to TO_SUBMIT queued entries, then waits until at
+   least MIN_COMPLETE completions are waiting to be consumed or
+   nothing remains in flight.  Returns the number of entries
+   submitted, or -1 if the process has no ring. */
+int
+aio_enter (unsigned to_submit, unsigned min_complete) {
+	struct aio_ctx *ctx = thread_current ()->aio;
+	int submitted;
+
+	if (ctx == NULL)
+		return -1;
+	submitted = submit (ctx, to_submit);
+	if (min_complete > AIO_ENTRIES)
+		min_complete = AIO_ENTRIES;
+
+	publish (ctx);
+	while (cq_used (ctx->ring) < min_complete && ctx->outstanding > 0) {
+		lock_acquire (&ctx->lock);
+		while (list_empty (&ctx->done))
+			cond_wait (&ctx->done_cond, &ctx->lock);
+		lock_release (&ctx->lock);
+		publish (ctx);
+	}
+	return submitted;
+}
+
+/* Waits for the running process's requests to finish and frees
+   its asynchronous I/O state.  The ring page itself goes with the
+   address space. */
+void
+aio_destroy (void) {
+	struct thread *t = thread_current ();
+	struct aio_ctx *ctx = t->aio;
+
+	if (ctx == NULL)
+		return;
+	t->aio = NULL;
+
+	lock_acquire (&ctx->lock);
+	while (ctx->inflight > 0)
+		cond_wait (&ctx->done_cond, &ctx->lock);
+	lock_release (&ctx->lock);
+
+	while (!list_empty (&ctx->done))
+		req_free (list_entry (list_pop_front (&ctx->done),
+					struct aio_req, elem));
+	free (ctx);
+}
+
+/* Carries out REQ in a worker thread. */
+static void
+run (struct aio_req *req) {
+	struct aio_sqe *sqe = &req->sqe;
+	struct thread *t = thread_current ();
+
+	switch (sqe->opcode) {
+		case AIO_READ:
+			req->res = file_read_at (req->file, req->kbuf, sqe->len, sqe->offset);
+			break;
+
+		case AIO_WRITE:
+			req->res = file_write_at (req->file, req->kbuf, sqe->len, sqe->offset);
+			break;
+
+		case AIO_FSYNC:
+			journal_commit ();
+			buffer_cache_flush ();
+			req->res = 0;
+			break;
+
+		case AIO_OPEN:
+			/* Look the name up relative to the process's working
+			   directory, and hand the directory back afterward. */
+			t->cwd = req->cwd;
+			req->file = filesys_open (req->kbuf);
+			req->cwd = t->cwd;
+			t->cwd = NULL;
+			req->res = req->file != NULL ? 0 : -1;
+			break;
+
+		default:
+			NOT_REACHED ();
+	}
+}
+
+/* Worker thread: runs queued requests and posts them to their
+   owners' done lists. */
+static void
+worker (void *aux UNUSED) {
+	for (;;) {
+		struct aio_req *req;
+		struct aio_ctx *ctx;
+
+		lock_acquire (&work_lock);
+		while (list_empty (&work_queue))
+			cond_wait (&work_cond, &work_lock);
+		req = list_entry (list_pop_front (&work_queue), struct aio_req, elem);
+		lock_release (&work_lock);
+
+		run (req);
+
+		ctx = req->ctx;
+		lock_acquire (&ctx->lock);
+		list_push_back (&ctx->done, &req->elem);
+		ctx->inflight--;
+		cond_broadcast (&ctx->done_cond, &ctx->lock);
+		lock_release (&ctx->lock);
+	}
+}
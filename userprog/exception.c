@@ -2,6 +2,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/usercopy.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "intrinsic.h"
@@ -47,8 +48,6 @@ exception_init (void) {
 	intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
 	intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
 	intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-	intr_register_int (7, 0, INTR_ON, kill,
-			"#NM Device Not Available Exception");
 	intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
 	intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
 	intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -148,6 +147,17 @@ page_fault (struct intr_frame *f) {
 	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
 		return;
 #endif
+	/* A kernel fault inside copyin(), copyout(), or
+	   strncpy_from_user() means a system call was handed a bad
+	   user pointer.  Make the primitive report failure. */
+	if (!user) {
+		uintptr_t fixup = usercopy_fixup (f->rip);
+		if (fixup != 0) {
+			f->rip = fixup;
+			return;
+		}
+	}
+
 	if (not_present || user)
 	{
 		thread_current()->exit_status = -1;
@@ -7,12 +7,15 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/tss.h"
+#include "userprog/aio.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -188,6 +191,11 @@ __do_fork (void *aux) {
 		if (parent->fd_table[i] != NULL)
 			current->fd_table[i] = file_duplicate(parent->fd_table[i]);
 	}
+	if (parent->cwd != NULL)
+		current->cwd = dir_reopen (parent->cwd);
+
+	if (!fpu_copy (current, parent))
+		goto error;
 
 	process_init ();
 	sema_up(&parent->fork_sema);
@@ -318,6 +326,11 @@ static void
 process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
+	aio_destroy ();
+	fpu_discard (curr);
+	dir_close (curr->cwd);
+	curr->cwd = NULL;
+
 #ifdef VM
 	supplemental_page_table_kill (&curr->spt);
 #endif
@@ -539,7 +552,12 @@ load (const char *file_name, struct intr_frame *if_) {
 		argv[i] = (char*)if_->rsp;
 	}
 
-	if_->rsp = ROUND_DOWN(if_->rsp, 8);
+	/* Put argv[] on a 16-byte boundary, so that _start() finds rsp
+	 * just past one, as if called.  The ABI requires this, and
+	 * compiler-generated SSE code relies on it. */
+	if_->rsp = ROUND_DOWN(if_->rsp, 16);
+	if ((argc + 1) % 2 != 0)
+		if_->rsp -= 8;
 
 	for (i = argc; i >= 0; i--){
 		if_->rsp -= sizeof(argv[i]);
@@ -996,6 +1014,29 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+		/* A read-only page that is file data up to its end, or up to
+		 * the end of the file, is the page cache's copy: every
+		 * process running this binary maps the same frame. */
+		if (!writable && (page_read_bytes == PGSIZE
+					|| ofs + (off_t) page_read_bytes >= file_length (file))) {
+			struct page_cache *pc = page_cache_map_info (file_get_inode (file),
+					ofs, NULL);
+
+			if (pc == NULL)
+				return false;
+			if (!vm_alloc_page_with_initializer (VM_PAGE_CACHE, upage,
+						false, NULL, pc)) {
+				page_cache_unmap (pc, false);
+				free (pc);
+				return false;
+			}
+			read_bytes -= page_read_bytes;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
+			ofs += page_read_bytes;
+			continue;
+		}
+
 		/* page가 생성될 때마다 malloc 해줘야 함 */
 		struct load_segment_info *info = malloc(sizeof(struct load_segment_info));
 		if (info == NULL) PANIC("TODO");
@@ -10,7 +10,13 @@
 #include "intrinsic.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/palloc.h"
+#include "userprog/usercopy.h"
+#include "userprog/aio.h"
+#include "devices/input.h"
+#include "threads/malloc.h"
+#include <limits.h>
 
 
 void syscall_entry (void);
@@ -59,95 +65,505 @@ exit(int status) {
 	thread_exit();
 }
 
+/* Copies user string USTR into a newly allocated page, which
+   the caller must free with palloc_free_page().  Returns NULL if
+   the string does not fit in a page.  Kills the process if USTR
+   is a bad pointer. */
+static char *
+copy_in_string (const char *ustr) {
+	char *kstr = palloc_get_page (0);
+	int64_t len;
+
+	if (kstr == NULL)
+		exit (-1);
+	len = strncpy_from_user (kstr, ustr, PGSIZE);
+	if (len < 0) {
+		palloc_free_page (kstr);
+		exit (-1);
+	}
+	if (len == PGSIZE) {
+		palloc_free_page (kstr);
+		return NULL;
+	}
+	return kstr;
+}
+
 bool
 create(char *cur_file, size_t size) {
-	if (cur_file == NULL || !is_user_vaddr(cur_file) || !pml4_get_page(thread_current()->pml4, cur_file))
-	{
-		thread_current()->exit_status = -1;
-		thread_exit();
-		return;
-	}
-	return filesys_create (cur_file, size); 
+	char *name = copy_in_string (cur_file);
+	bool success = name != NULL && filesys_create (name, size);
+
+	palloc_free_page (name);
+	return success;
 }
 
-int 
-write(int fd, void *buffer, size_t size) {
-	struct thread *curr = thread_current();
+/* One buffer of a readv() or writev() call.  Matches the layout
+   in lib/user/syscall.h. */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+/* Maximum number of buffers in a readv() or writev() call. */
+#define IOV_MAX 64
+
+/* Writes SIZE bytes from KBUF to FD, the console if FD is 1 and
+   otherwise FILE.  A file is written at *POS, which is advanced,
+   if POS is nonnull, and at its own position otherwise.  Returns
+   the number of bytes written. */
+static size_t
+put_chunk (int fd, struct file *file, off_t *pos, const void *kbuf,
+		size_t size) {
+	size_t written;
 
 	if (fd == 1) {
-		putbuf((char *)buffer, size);
+		putbuf (kbuf, size);
 		return size;
+	}
+	if (pos == NULL)
+		return file_write (file, kbuf, size);
+	written = file_write_at (file, kbuf, size, *pos);
+	*pos += written;
+	return written;
+}
+
+/* Reads up to SIZE bytes from FD into KBUF, the keyboard if FD
+   is 0 and otherwise FILE, positioned as for put_chunk().
+   Returns the number of bytes read. */
+static size_t
+get_chunk (int fd, struct file *file, off_t *pos, char *kbuf, size_t size) {
+	size_t got, i;
+
+	if (fd == 0) {
+		for (i = 0; i < size; i++)
+			kbuf[i] = input_getc ();
+		return size;
+	}
+	if (pos == NULL)
+		return file_read (file, kbuf, size);
+	got = file_read_at (file, kbuf, size, *pos);
+	*pos += got;
+	return got;
+}
+
+/* User buffers are staged through a kernel page, PGSIZE bytes at
+   a time, so that every byte is checked by copyin() or
+   copyout() however many pages the buffer spans. */
+static int
+write_user (int fd, struct file *file, off_t *pos, const void *buffer,
+		size_t size) {
+	char *kbuf = palloc_get_page (0);
+	size_t done = 0;
+
+	if (kbuf == NULL)
+		return -1;
+	while (done < size) {
+		size_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+		size_t written;
+
+		if (!copyin (kbuf, (char *) buffer + done, chunk)) {
+			palloc_free_page (kbuf);
+			exit (-1);
+		}
+		written = put_chunk (fd, file, pos, kbuf, chunk);
+		done += written;
+		if (written < chunk)
+			break;
+	}
+	palloc_free_page (kbuf);
+	return done;
+}
+
+static int
+read_user (int fd, struct file *file, off_t *pos, void *buffer,
+		size_t size) {
+	char *kbuf = palloc_get_page (0);
+	off_t start = file != NULL && pos == NULL ? file_tell (file) : 0;
+	size_t done = 0;
+
+	if (kbuf == NULL)
+		return -1;
+	while (done < size) {
+		size_t chunk = size - done < PGSIZE ? size - done : PGSIZE;
+		size_t got = get_chunk (fd, file, pos, kbuf, chunk);
+
+		if (!copyout ((char *) buffer + done, kbuf, got)) {
+			/* The file position covers only what was delivered. */
+			if (file != NULL && pos == NULL)
+				file_seek (file, start + done);
+			palloc_free_page (kbuf);
+			exit (-1);
+		}
+		done += got;
+		if (got < chunk)
+			break;
+	}
+	palloc_free_page (kbuf);
+	return done;
+}
 
-	} else if (is_valid_fd(fd)) {
-		struct file *cur_file = thread_current()->fd_table[fd];
-		size_t real_size = file_write(cur_file, (char *)buffer, size);
-		return real_size;
+int 
+write(int fd, void *buffer, size_t size) {
+	struct file *file = NULL;
+
+	if (fd != 1) {
+		if (!is_valid_fd (fd))
+			return -1;
+		file = thread_current ()->fd_table[fd];
+		if (!file_can_write (file))
+			return -1;
 	}
+	return write_user (fd, file, NULL, buffer, size);
 }
 
 int
 read(int fd, void *buffer, size_t size) {
-	if (pml4_get_page(thread_current()->pml4, buffer) 
-		&& !spt_find_page(&thread_current()->spt, buffer)->writable) {
-			thread_current()->exit_status = -1;
-			thread_exit();
+	struct file *file = NULL;
+
+	if (fd != 0) {
+		if (!is_valid_fd (fd))
+			exit (-1);
+		file = thread_current ()->fd_table[fd];
+		if (!file_can_read (file))
+			return -1;
 	}
+	return read_user (fd, file, NULL, buffer, size);
+}
 
-	if (fd == 0 && buffer != NULL) return input_getc();
-	else if (2 < fd && fd < 30 && buffer != NULL) 
-	{
-		struct file *file = thread_current()->fd_table[fd];
-		// printf("HELLO\n");
-		return file_read(file, (char *)buffer, size);
+/* Writes SIZE bytes from BUFFER to FD at OFFSET, leaving the
+   file position alone.  A pipe has no offsets, so fails. */
+static int
+pwrite (int fd, const void *buffer, size_t size, off_t offset) {
+	if (!is_valid_fd (fd) || offset < 0
+			|| file_is_pipe (thread_current ()->fd_table[fd]))
+		return -1;
+	return write_user (fd, thread_current ()->fd_table[fd], &offset,
+			buffer, size);
+}
+
+/* Reads up to SIZE bytes from FD at OFFSET into BUFFER, leaving
+   the file position alone.  A pipe has no offsets, so fails. */
+static int
+pread (int fd, void *buffer, size_t size, off_t offset) {
+	if (!is_valid_fd (fd) || offset < 0
+			|| file_is_pipe (thread_current ()->fd_table[fd]))
+		return -1;
+	return read_user (fd, thread_current ()->fd_table[fd], &offset,
+			buffer, size);
+}
+
+/* Copies up to LENGTH bytes from IN_FD to OUT_FD, the console if
+   OUT_FD is 1, starting at each file's position and advancing
+   it.  The data moves through a kernel page and never enters
+   user space.  Returns the number of bytes copied, which falls
+   short of LENGTH at end of file.  Returns -1 if both descriptors
+   name the same file and the two ranges overlap, since the copy
+   would read back bytes it had already overwritten. */
+static int
+copy_fd (int in_fd, int out_fd, size_t length) {
+	struct file *in, *out = NULL;
+	char *kbuf;
+	size_t done = 0;
+
+	if (!is_valid_fd (in_fd))
+		return -1;
+	in = thread_current ()->fd_table[in_fd];
+	if (!file_can_read (in))
+		return -1;
+	if (out_fd != 1) {
+		if (!is_valid_fd (out_fd))
+			return -1;
+		out = thread_current ()->fd_table[out_fd];
+		if (!file_can_write (out))
+			return -1;
 	}
-	else 
-	{
-		thread_current()->exit_status = -1;
-		thread_exit();
-		return;
+	if (length > INT_MAX)
+		length = INT_MAX;
+	if (out != NULL && file_get_inode (in) != NULL
+			&& file_get_inode (in) == file_get_inode (out)) {
+		int64_t in_pos = file_tell (in), out_pos = file_tell (out);
+
+		if (length > 0 && in_pos < out_pos + (int64_t) length
+				&& out_pos < in_pos + (int64_t) length)
+			return -1;
+	}
+
+	kbuf = palloc_get_page (0);
+	if (kbuf == NULL)
+		return -1;
+	while (done < length) {
+		size_t chunk = length - done < PGSIZE ? length - done : PGSIZE;
+		size_t got = get_chunk (in_fd, in, NULL, kbuf, chunk);
+		size_t written;
+
+		if (got == 0)
+			break;
+		written = put_chunk (out_fd, out, NULL, kbuf, got);
+		done += written;
+		if (written < got || got < chunk)
+			break;
+	}
+	palloc_free_page (kbuf);
+	return done;
+}
+
+/* Copies LENGTH bytes between two open files without a trip
+   through user space. */
+static int
+copy_file_range (int in_fd, int out_fd, size_t length) {
+	if (!is_valid_fd (out_fd))
+		return -1;
+	return copy_fd (in_fd, out_fd, length);
+}
+
+/* Like copy_file_range(), but OUT_FD may also be the console. */
+static int
+sendfile (int out_fd, int in_fd, size_t length) {
+	return copy_fd (in_fd, out_fd, length);
+}
+
+/* Creates a pipe and stores descriptors for its read and write
+   ends in FDS[0] and FDS[1].  Returns 0, or -1 on failure. */
+static int
+pipe (int *fds) {
+	struct file *ends[2];
+	int kfds[2];
+
+	if (!file_pipe (ends))
+		return -1;
+	kfds[0] = fd_install (ends[0]);
+	kfds[1] = kfds[0] >= 0 ? fd_install (ends[1]) : -1;
+	if (kfds[1] < 0) {
+		if (kfds[0] >= 0)
+			thread_current ()->fd_table[kfds[0]] = NULL;
+		file_close (ends[0]);
+		file_close (ends[1]);
+		return -1;
+	}
+	/* Exiting closes both descriptors. */
+	if (!copyout (fds, kfds, sizeof kfds))
+		exit (-1);
+	return 0;
+}
+
+/* Copies in the IOVCNT-element iovec array at UIOV and checks it
+   as a whole, before any data moves.  Returns a kernel copy,
+   which the caller must free(), and stores the total length in
+   *TOTAL; or returns NULL if IOVCNT or the total is out of
+   range.  Kills the process if UIOV or any of the buffers it
+   lists is a bad pointer, or if WRITE and a buffer is read-only,
+   so that a bad fragment never leaves a partial transfer behind. */
+static struct iovec *
+copy_in_iovec (const struct iovec *uiov, int iovcnt, bool write,
+		size_t *total) {
+	struct iovec *iov;
+	size_t sum = 0;
+	int i;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX)
+		return NULL;
+	iov = malloc (iovcnt * sizeof *iov);
+	if (iov == NULL)
+		return NULL;
+	if (!copyin (iov, uiov, iovcnt * sizeof *iov)) {
+		free (iov);
+		exit (-1);
+	}
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > (size_t) INT_MAX - sum) {
+			free (iov);
+			return NULL;
+		}
+		sum += iov[i].iov_len;
+	}
+	for (i = 0; i < iovcnt; i++)
+		if (!probe_user (iov[i].iov_base, iov[i].iov_len, write)) {
+			free (iov);
+			exit (-1);
+		}
+	*total = sum;
+	return iov;
+}
+
+/* Writes the IOVCNT buffers at UIOV to FD in order.  Fragments
+   are gathered into the staging page first, so the file system
+   sees one contiguous write per page rather than one per
+   fragment, and neighbouring fragments land in the same sectors
+   in a single pass.  The pages of a write to a file are one
+   journal operation, so the metadata they change commits
+   together.  A pipe is left out of it, since a write to a pipe
+   may block until its reader has done something else. */
+static int
+writev (int fd, const struct iovec *uiov, int iovcnt) {
+	struct file *file = NULL;
+	struct iovec *iov;
+	size_t total, done = 0, ofs = 0;
+	bool atomic;
+	char *kbuf;
+	int i = 0;
+
+	if (fd != 1) {
+		if (!is_valid_fd (fd))
+			return -1;
+		file = thread_current ()->fd_table[fd];
+		if (!file_can_write (file))
+			return -1;
+	}
+	iov = copy_in_iovec (uiov, iovcnt, false, &total);
+	if (iov == NULL)
+		return -1;
+	kbuf = palloc_get_page (0);
+	if (kbuf == NULL) {
+		free (iov);
+		return -1;
 	}
+
+	atomic = file != NULL && !file_is_pipe (file);
+	if (atomic)
+		journal_begin ();
+	while (done < total) {
+		size_t fill = 0, written;
+
+		while (fill < PGSIZE && i < iovcnt) {
+			size_t left = iov[i].iov_len - ofs;
+			size_t n = left < PGSIZE - fill ? left : PGSIZE - fill;
+
+			if (!copyin (kbuf + fill, (char *) iov[i].iov_base + ofs, n)) {
+				if (atomic)
+					journal_end ();
+				palloc_free_page (kbuf);
+				free (iov);
+				exit (-1);
+			}
+			fill += n;
+			ofs += n;
+			if (ofs == iov[i].iov_len) {
+				i++;
+				ofs = 0;
+			}
+		}
+		written = put_chunk (fd, file, NULL, kbuf, fill);
+		done += written;
+		if (written < fill)
+			break;
+	}
+	if (atomic)
+		journal_end ();
+	palloc_free_page (kbuf);
+	free (iov);
+	return done;
+}
+
+/* Reads from FD into the IOVCNT buffers at UIOV in order, a page
+   at a time, scattering each page across as many buffers as it
+   covers. */
+static int
+readv (int fd, const struct iovec *uiov, int iovcnt) {
+	struct file *file = NULL;
+	struct iovec *iov;
+	size_t total, done = 0, ofs = 0;
+	off_t start;
+	char *kbuf;
+	int i = 0;
+
+	if (fd != 0) {
+		if (!is_valid_fd (fd))
+			return -1;
+		file = thread_current ()->fd_table[fd];
+		if (!file_can_read (file))
+			return -1;
+	}
+	iov = copy_in_iovec (uiov, iovcnt, true, &total);
+	if (iov == NULL)
+		return -1;
+	kbuf = palloc_get_page (0);
+	if (kbuf == NULL) {
+		free (iov);
+		return -1;
+	}
+	start = file != NULL ? file_tell (file) : 0;
+
+	while (done < total) {
+		size_t chunk = total - done < PGSIZE ? total - done : PGSIZE;
+		size_t got = get_chunk (fd, file, NULL, kbuf, chunk);
+		size_t used = 0;
+
+		while (used < got) {
+			size_t left = iov[i].iov_len - ofs;
+			size_t n = left < got - used ? left : got - used;
+
+			if (!copyout ((char *) iov[i].iov_base + ofs, kbuf + used, n)) {
+				/* The file position covers only what was delivered. */
+				if (file != NULL)
+					file_seek (file, start + done + used);
+				palloc_free_page (kbuf);
+				free (iov);
+				exit (-1);
+			}
+			used += n;
+			ofs += n;
+			if (ofs == iov[i].iov_len) {
+				i++;
+				ofs = 0;
+			}
+		}
+		done += got;
+		if (got < chunk)
+			break;
+	}
+	palloc_free_page (kbuf);
+	free (iov);
+	return done;
 }
 
 tid_t
 fork (char *thread_name, struct intr_frame *user_frame){
+	char name[sizeof thread_current ()->name];
+
 	memcpy(&thread_current()->user_if, user_frame, sizeof(struct intr_frame));
 
 	/* fork를 통해 복제된 thread와 thread 생성시 만들어진 child는 다른데..ㅠㅠㅠ */
 
-	tid_t child_tid = process_fork (thread_name, user_frame);
+	if (strncpy_from_user (name, thread_name, sizeof name) < 0)
+		exit (-1);
+	name[sizeof name - 1] = '\0';
+
+	tid_t child_tid = process_fork (name, user_frame);
 	if (child_tid == -1) return TID_ERROR;
 
 	return child_tid;
 }
 
+/* Gives FILE the lowest free descriptor of the running process
+   and returns it, or returns -1 if the table is full. */
 int
-open(char *file_name) {
+fd_install (struct file *file) {
 	struct thread *t = thread_current();
-	// /* 에러처리할 때 pml4 정리할 것 */
-	// if (file_name == NULL || !is_user_vaddr(file_name))
-	if (file_name == NULL || !is_user_vaddr(file_name) || !pml4_get_page(thread_current()->pml4, file_name))
-	{	
-		thread_current()->exit_status = -1;
-		thread_exit();
-		
-	}
-
-	struct file *cur_file = filesys_open(file_name);
-	
-	if (cur_file == NULL) return -1;
-	
 	int i = 3;
-	while (t->fd_table[i] != NULL && i < FD_MAX) 
+
+	while (i < FD_MAX && t->fd_table[i] != NULL)
 		i++;
+	if (i == FD_MAX)
+		return -1;
+	t->fd_table[i] = file;
+	return i;
+}
+
+int
+open(char *file_name) {
+	char *name = copy_in_string (file_name);
+
+	if (name == NULL)
+		return -1;
+	struct file *cur_file = filesys_open(name);
+	palloc_free_page (name);
 	
-	if (i < FD_MAX) {
-		t->fd_table[i] = cur_file;
-		// printf("open fd: %d\n", i);
-		return i;
-	}
+	if (cur_file == NULL) return -1;
 	
-	file_close(cur_file);
-	return -1;
+	int fd = fd_install (cur_file);
+	if (fd < 0)
+		file_close(cur_file);
+	return fd;
 }
 
 int
@@ -162,21 +578,10 @@ filesize (int fd) {
 
 void
 exec(char *cmd_line, struct intr_frame *f){
-	/* address가 유효한 address인지 확인하는 코드 */
-	if (cmd_line == NULL || !is_user_vaddr(cmd_line) || !pml4_get_page(thread_current()->pml4, cmd_line))
-	{	
-		thread_current()->exit_status = -1;
-		thread_exit();
-		
-	}
-
-	/* pid */
-	char *fn_copy = palloc_get_page(PAL_ZERO);
+	char *fn_copy = copy_in_string (cmd_line);
 	if (fn_copy == NULL)
 		exit(-1);
 
-	strlcpy(fn_copy, cmd_line, PGSIZE);
-
 	// printf("process exec 실행한다1!!\n");
 	if (process_exec(fn_copy) < 0) {
 		f->R.rax = -1;
@@ -193,12 +598,11 @@ wait(tid_t tid) {
 
 bool
 remove (char *file_name) {
-	// /* 에러처리용 수정 */
-	// if (file_name == NULL || !is_user_vaddr(file_name))
-	if (file_name == NULL || !is_user_vaddr(file_name) || pml4_get_page(thread_current()->pml4, file_name) == NULL)
-		return false;
-	
-	return filesys_remove(file_name);
+	char *name = copy_in_string (file_name);
+	bool success = name != NULL && filesys_remove (name);
+
+	palloc_free_page (name);
+	return success;
 }
 
 void
@@ -228,10 +632,20 @@ mmap(void *addr, size_t length, int writable, struct file *file, off_t offset) {
 	return do_mmap(addr, length, writable, file, offset);
 }
 
+static void
+munmap(void *addr) {
+	do_munmap(addr);
+}
+
 /* The main system call interface */
 void
 syscall_handler (struct intr_frame *f UNUSED) {
 	thread_current()->is_user = true;
+#ifdef VM
+	/* Lets page faults taken while copying user buffers grow the
+	   stack just as a fault in user mode would. */
+	thread_current ()->stack_ptr = (void *) f->rsp;
+#endif
 
 	switch (f->R.rax) {
 	case SYS_HALT:     			/* (0) Halt the operating system. */
@@ -338,14 +752,85 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		int writable = f->R.rdx;
 		int fd = f->R.r10;
 		off_t offset = f->R.r8;
-		struct file *file = thread_current()->fd_table[fd];
+		struct file *file = is_valid_fd(fd) ? thread_current()->fd_table[fd] : NULL;
 		
 		f->R.rax = mmap(addr, length, writable, file, offset);
 		break;
 	}
+	case SYS_PREAD:
+	{
+		int fd = f->R.rdi;
+		void *buffer = (void *) f->R.rsi;
+		size_t size = f->R.rdx;
+		off_t offset = f->R.r10;
+		f->R.rax = pread(fd, buffer, size, offset);
+		break;
+	}
+	case SYS_PWRITE:
+	{
+		int fd = f->R.rdi;
+		const void *buffer = (const void *) f->R.rsi;
+		size_t size = f->R.rdx;
+		off_t offset = f->R.r10;
+		f->R.rax = pwrite(fd, buffer, size, offset);
+		break;
+	}
+	case SYS_READV:
+	{
+		int fd = f->R.rdi;
+		const struct iovec *iov = (const struct iovec *) f->R.rsi;
+		int iovcnt = f->R.rdx;
+		f->R.rax = readv(fd, iov, iovcnt);
+		break;
+	}
+	case SYS_WRITEV:
+	{
+		int fd = f->R.rdi;
+		const struct iovec *iov = (const struct iovec *) f->R.rsi;
+		int iovcnt = f->R.rdx;
+		f->R.rax = writev(fd, iov, iovcnt);
+		break;
+	}
+	case SYS_COPY_FILE_RANGE:
+	{
+		int in_fd = f->R.rdi;
+		int out_fd = f->R.rsi;
+		size_t length = f->R.rdx;
+		f->R.rax = copy_file_range(in_fd, out_fd, length);
+		break;
+	}
+	case SYS_SENDFILE:
+	{
+		int out_fd = f->R.rdi;
+		int in_fd = f->R.rsi;
+		size_t length = f->R.rdx;
+		f->R.rax = sendfile(out_fd, in_fd, length);
+		break;
+	}
+	case SYS_AIO_SETUP:
+	{
+		void *addr = (void *) f->R.rdi;
+		f->R.rax = (uint64_t) aio_setup(addr);
+		break;
+	}
+	case SYS_AIO_ENTER:
+	{
+		unsigned to_submit = f->R.rdi;
+		unsigned min_complete = f->R.rsi;
+		f->R.rax = aio_enter(to_submit, min_complete);
+		break;
+	}
+	case SYS_PIPE:
+	{
+		int *fds = (int *) f->R.rdi;
+		f->R.rax = pipe(fds);
+		break;
+	}
 	case SYS_MUNMAP:
 	{
-
+		void *addr = (void *) f->R.rdi;
+		munmap(addr);
+		break;
 	}
 
 	default:
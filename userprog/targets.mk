@@ -2,5 +2,8 @@ userprog_SRC  = userprog/process.c	# Process loading.
 userprog_SRC += userprog/exception.c	# User exception handler.
 userprog_SRC += userprog/syscall-entry.S # System call entry.
 userprog_SRC += userprog/syscall.c	# System call handler.
+userprog_SRC += userprog/usercopy.c	# User memory access.
+userprog_SRC += userprog/usercopy-asm.S # User memory access primitives.
+userprog_SRC += userprog/aio.c		# Asynchronous I/O rings.
 userprog_SRC += userprog/gdt.c		# GDT initialization.
 userprog_SRC += userprog/tss.c		# TSS management.
@@ -0,0 +1,96 @@
+#include "userprog/usercopy.h"
+#include "threads/vaddr.h"
+
+/* Kernel access to user memory.
+
+   These routines do not look at page tables.  They check only
+   that the user range lies below KERN_BASE and then access it
+   directly; if the access faults and the page cannot be brought
+   in, page_fault() resumes at the fixup address recorded for the
+   faulting instruction in usercopy-asm.S.  CR0.WP is set, so a
+   write to a read-only user page faults too. */
+
+/* Defined in usercopy-asm.S. */
+size_t usercopy_bytes (void *dst, const void *src, size_t size);
+int64_t usercopy_string (char *dst, const char *src, size_t size);
+extern const uintptr_t usercopy_fixups[][2];
+
+/* Returns true if the SIZE bytes starting at UADDR are all user
+   virtual addresses. */
+static bool
+is_user_range (const void *uaddr, size_t size) {
+	uintptr_t start = (uintptr_t) uaddr;
+	return start + size >= start && start + size <= KERN_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns
+   true if successful, false if any byte of USRC is inaccessible. */
+bool
+copyin (void *dst, const void *usrc, size_t size) {
+	return is_user_range (usrc, size)
+		&& usercopy_bytes (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns true
+   if successful, false if any byte of UDST is not writable. */
+bool
+copyout (void *udst, const void *src, size_t size) {
+	return is_user_range (udst, size)
+		&& usercopy_bytes (udst, src, size) == 0;
+}
+
+/* Returns true if all SIZE bytes at user address UADDR can be
+   read, and also written if WRITE, by touching one byte in each
+   page they span.  A write puts back the byte just read, so user
+   memory is left as it was. */
+bool
+probe_user (const void *uaddr, size_t size, bool write) {
+	uint8_t *p = (uint8_t *) uaddr;
+	uint8_t *end = p + size;
+	uint8_t byte;
+
+	if (!is_user_range (uaddr, size))
+		return false;
+	while (p < end) {
+		if (usercopy_bytes (&byte, p, 1) != 0
+				|| (write && usercopy_bytes (p, &byte, 1) != 0))
+			return false;
+		p = (uint8_t *) pg_round_down (p) + PGSIZE;
+	}
+	return true;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, copying at most SIZE bytes.  Returns the length of the
+   string, or SIZE if it did not fit, in which case DST is not
+   null-terminated.  Returns -1 if USRC is inaccessible. */
+int64_t
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	uintptr_t start = (uintptr_t) usrc;
+	size_t limit = size;
+	int64_t len;
+
+	if (!is_user_vaddr (usrc))
+		return -1;
+
+	/* A string that runs into kernel space is as bad as one that
+	   runs into an unmapped page. */
+	if (limit > KERN_BASE - start)
+		limit = KERN_BASE - start;
+	len = usercopy_string (dst, usrc, limit);
+	if (len == (int64_t) limit && limit < size)
+		return -1;
+	return len;
+}
+
+/* If RIP is an instruction in usercopy-asm.S that is allowed to
+   fault, returns the address to resume at; otherwise, 0. */
+uintptr_t
+usercopy_fixup (uintptr_t rip) {
+	size_t i;
+
+	for (i = 0; usercopy_fixups[i][0] != 0; i++)
+		if (usercopy_fixups[i][0] == rip)
+			return usercopy_fixups[i][1];
+	return 0;
+}
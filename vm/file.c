@@ -1,7 +1,9 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
 #include "userprog/process.h"
+#include "threads/malloc.h"
 #include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -48,80 +50,61 @@ file_backed_destroy (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
 }
 
-static bool
-file_lazy_load_segment (struct page *page, void *aux) {
-	struct file *file = ((struct load_segment_info *)aux)->file;
-	off_t ofs = ((struct load_segment_info *)aux)->ofs;
-	uint8_t *upage = ((struct load_segment_info *)aux)->upage;
-	uint32_t read_bytes = ((struct load_segment_info *)aux)->read_bytes;
-	uint32_t zero_bytes = ((struct load_segment_info *)aux)->zero_bytes;
-	bool writable = ((struct load_segment_info *)aux)->writable;
-
-	file_seek(file, ofs);
-	/* Do calculate how to fill this page.
-	* We will read PAGE_READ_BYTES bytes from FILE
-	* and zero the final PAGE_ZERO_BYTES bytes. */
-	size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-	size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
- 	/* Kernel page */
-	void *kpage = page->frame->kva;
-
- 	/* Load this page. */
-	if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes) {
-		palloc_free_page (page);
-		return false;
-	}
-	
-	memset (kpage + page_read_bytes, 0, page_zero_bytes);
-	return true;
-	
-
-}
-
-/* Do the mmap */
+/* Do the mmap.  Each page of the region is a VM_PAGE_CACHE page:
+ * on its first fault it maps the page cache's copy of the file
+ * page, which every other mapping of that page and read() share. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
-
-	// printf("do mmap? \n");
-
-	void *start_addr = addr;
-	// printf("reopen file before \n");
-	// printf("reopen file before addr: %p\n", file);
-	struct file *reopen_file = file_reopen(file);
-	// printf("re open file after\n");
-	/* length에 사용하는 것임. 즉, length를 page size규격에 맞춰서
-	 * 반올림하여 pgsize로 나누면 페이지가 몇 개 쓰이는 지 알 수 있음 */
-	int page_cnt = (int)pg_round_up(length) / PGSIZE; 
-	// printf("page cnt: %d\n", page_cnt);
-	off_t file_size = file_length(reopen_file);
-
-	while (page_cnt > 0) {
-		struct load_segment_info *info = malloc(sizeof(struct load_segment_info));
-		if (info == NULL) PANIC("TODO");
-
-		size_t page_read_bytes = file_size < PGSIZE ? file_size : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		info->file = file; //데이터를 읽어올 파일.
-		info->ofs = offset; //파일에서 데이터를 읽기 시작할 오프셋.
-		info->upage = addr; //가상 메모리 주소.
-		info->read_bytes = page_read_bytes; //읽어야 할 바이트 수.
-		info->zero_bytes = page_zero_bytes; //0으로 채워야 할 바이트 수.
-		info->writable = writable; //메모리가 쓰기 가능한지 여부.
-
-		if (!vm_alloc_page_with_initializer(VM_FILE, addr, writable, file_lazy_load_segment, info)) return NULL;
-
-		page_cnt--;
-		file_size -= PGSIZE;
-		offset += page_read_bytes;
-		addr += PGSIZE;
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct inode *inode;
+	size_t page_cnt, i;
+
+	if (file == NULL || addr == NULL || pg_ofs (addr) != 0
+			|| offset < 0 || offset % PGSIZE != 0 || length == 0
+			|| !is_user_vaddr (addr) || !is_user_vaddr (addr + length - 1)
+			|| (uint8_t *) addr + length < (uint8_t *) addr
+			|| file_length (file) == 0)
+		return NULL;
+	page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	for (i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, addr + i * PGSIZE) != NULL)
+			return NULL;
+
+	inode = file_get_inode (file);
+	for (i = 0; i < page_cnt; i++) {
+		struct page_cache *info = page_cache_map_info (inode,
+				offset + i * PGSIZE, addr);
+
+		if (info == NULL
+				|| !vm_alloc_page_with_initializer (VM_PAGE_CACHE,
+					addr + i * PGSIZE, writable, NULL, info)) {
+			if (info != NULL) {
+				page_cache_unmap (info, false);
+				free (info);
+			}
+			do_munmap (addr);
+			return NULL;
+		}
 	}
-	return start_addr;
+	return addr;
 }
 
-/* Do the munmap */
+/* Do the munmap.  Pages written through the mapping reach the file
+ * once no other process has them mapped. */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *va;
+
+	if (addr == NULL)
+		return;
+	for (va = addr; ; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL || VM_TYPE (page_get_type (page)) != VM_PAGE_CACHE
+				|| page_cache_of (page)->map_addr != addr)
+			break;
+		spt_remove_page (spt, page);
+	}
 }
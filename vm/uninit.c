@@ -78,6 +78,10 @@ uninit_destroy (struct page *page) {
 			// initializer = &file_backed_initializer;
 			break;
 
+		case VM_PAGE_CACHE:
+			page_cache_unmap (uninit->aux, false);
+			break;
+
 		default:
 			break;
 	}
@@ -78,6 +78,10 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 			initializer = &file_backed_initializer;
 			break;
 
+		case VM_PAGE_CACHE:
+			initializer = &page_cache_initializer;
+			break;
+
 		default:
 			break;
 		}
@@ -127,6 +131,7 @@ spt_insert_page (struct supplemental_page_table *spt UNUSED,
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->hash, &page->hash_elem);
 	vm_dealloc_page (page);
 	return true;
 }
@@ -227,6 +232,11 @@ vm_try_handle_fault (struct intr_frame *f, void *addr,
 	struct supplemental_page_table *spt UNUSED = &curr->spt;
 	struct page *page = spt_find_page(spt, addr);
 	if (page == NULL) return false;
+
+	/* Writing a read-only page fails, whether the write comes from
+	 * the process or from copyout() on its behalf. */
+	if (write && !page->writable)
+		return false;
 	// printf("page->va: %p\n", page->va);
 
 	return vm_do_claim_page (page);
@@ -253,7 +263,11 @@ vm_claim_page (void *va UNUSED) {
 static bool
 vm_do_claim_page (struct page *page) {
 	//printf("어디에서 실패임?\n");
-	struct frame *frame = vm_get_frame ();
+	/* A mapped file page shares the page cache's frame. */
+	struct frame *frame = VM_TYPE (page_get_type (page)) == VM_PAGE_CACHE
+		? page_cache_get_frame (page) : vm_get_frame ();
+	if (frame == NULL)
+		return false;
 	
 	/* Set links */
 	frame->page = page;
@@ -287,6 +301,23 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 	while (hash_next(&i)) {
 		struct page *src_page = hash_entry(hash_cur(&i), struct page, hash_elem);
 		enum vm_type type = src_page->operations->type;
+
+		/* The child maps the same cache pages, on its own faults. */
+		if (VM_TYPE (page_get_type (src_page)) == VM_PAGE_CACHE) {
+			struct page_cache *pc = page_cache_of (src_page);
+			struct page_cache *info = page_cache_map_info (pc->inode, pc->ofs,
+					pc->map_addr);
+
+			if (info == NULL)
+				return false;
+			if (!vm_alloc_page_with_initializer (VM_PAGE_CACHE, src_page->va,
+						src_page->writable, NULL, info)) {
+				page_cache_unmap (info, false);
+				free (info);
+				return false;
+			}
+			continue;
+		}
 		// printf("src_page: %p\n thread_name: %s\n", src_page->va, thread_current()->name);
 		if (VM_TYPE(type) != VM_UNINIT) {
 			// bool (*initializer)(struct page *, enum vm_type, void *kva) = NULL;